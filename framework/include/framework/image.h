@@ -11,6 +11,7 @@ DISABLE_WARNINGS_POP()
 struct Image {
 public:
     explicit Image(const std::filesystem::path& filePath);
+    Image(int w, int h, std::vector<glm::vec3> data);
 
 public:
     int width, height;
@@ -6,4 +6,5 @@ DISABLE_WARNINGS_POP()
 #include <framework/trackball.h>
 #include <framework/window.h>
 
-void showImGuizmoTranslation(const Window& window, const Trackball& camera, glm::vec3& position);
+// Returns whether the position was moved this frame
+bool showImGuizmoTranslation(const Window& window, const Trackball& camera, glm::vec3& position);
@@ -9,6 +9,7 @@ DISABLE_WARNINGS_POP()
 #include <exception>
 #include <iostream>
 #include <string>
+#include <utility>
 
 Image::Image(const std::filesystem::path& filePath)
 {
@@ -33,3 +34,11 @@ Image::Image(const std::filesystem::path& filePath)
 
 	stbi_image_free(stbPixels);
 }
+
+Image::Image(int w, int h, std::vector<glm::vec3> data)
+	: width(w)
+	, height(h)
+	, pixels(std::move(data))
+{
+	assert(pixels.size() == static_cast<size_t>(width) * static_cast<size_t>(height));
+}
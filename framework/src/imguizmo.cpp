@@ -5,7 +5,7 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/gtc/type_ptr.hpp>
 DISABLE_WARNINGS_POP()
 
-void showImGuizmoTranslation(const Window& window, const Trackball& camera, glm::vec3& position)
+bool showImGuizmoTranslation(const Window& window, const Trackball& camera, glm::vec3& position)
 {
 	ImGuizmo::SetGizmoSizeClipSpace(0.15f * window.getDpiScalingFactor());
 	ImGuizmo::SetRect(0.0f, 0.0f, (float)window.getWindowSize().x, (float)window.getWindowSize().y);
@@ -22,4 +22,5 @@ void showImGuizmoTranslation(const Window& window, const Trackball& camera, glm:
 		ImGuizmo::DecomposeMatrixToComponents(
 			glm::value_ptr(modelMatrix), glm::value_ptr(position), glm::value_ptr(dummyRotation), glm::value_ptr(dummyScale));
 	}
+	return manipulated;
 }
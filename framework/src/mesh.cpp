@@ -135,6 +135,10 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool centerAndNorm
                 mesh.material.shininess = objMaterial.shininess;
             }
 
+            // Keep a spare vertex of capacity so that ray tracers binding the vertex storage in place
+            // (Embree reads the last element of a vertex buffer with a 16 byte load) stay within the allocation.
+            mesh.vertices.reserve(mesh.vertices.size() + 1);
+
             out.push_back(std::move(mesh));
 
             startTriangle = endTriangle;
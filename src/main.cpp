@@ -1,6 +1,6 @@
 #include <ray_tracing/embree_interface.h>
 #include <rendering/render.h>
-#include <rendering/reservoir.h>
+#include <rendering/reservoir_grid.h>
 #include <rendering/screen.h>
 #include <scene/light.h>
 #include <ui/draw.h>
@@ -62,7 +62,9 @@ int main(int argc, char** argv) {
         std::optional<RayHit> optDebugRayHit;
         Scene scene         = loadScenePrebuilt(sceneType, config.dataPath);
         EmbreeInterface embreeInterface(scene);
-        std::shared_ptr<ReservoirGrid> previousFrameGrid;
+        std::shared_ptr<AnyReservoirGrid> previousFrameGrid;
+        AnyReservoirGrid spatialSwapGrid;
+        uint32_t frameIdx   = 0U;
 
         int bvhDebugLevel       = 0;
         int bvhDebugLeaf        = 0;
@@ -71,8 +73,8 @@ int main(int argc, char** argv) {
         ViewMode viewMode       = ViewMode::Rasterization;
         int selectedLightIdx    = scene.lights.empty() ? -1 : 0;
 
-        UiManager uiManager(embreeInterface, camera, config, optDebugRayHit, previousFrameGrid, scene, sceneType, screen, viewMode, window,
-                            selectedLightIdx);
+        UiManager uiManager(embreeInterface, camera, config, optDebugRayHit, previousFrameGrid, spatialSwapGrid, scene, sceneType, screen, viewMode, window,
+                            selectedLightIdx, frameIdx);
 
         window.registerKeyCallback([&](int key, int /* scancode */, int action, int /* mods */) {
             if (action == GLFW_PRESS) {
@@ -138,7 +140,7 @@ int main(int argc, char** argv) {
                         enableDebugDraw = true;
                         glDisable(GL_LIGHTING);
                         glDepthFunc(GL_LEQUAL);
-                        embreeInterface.closestHit(optDebugRayHit.value().ray, optDebugRayHit.value().hit);
+                        embreeInterface.closestHit<DebugDrawOn>(optDebugRayHit.value().ray, optDebugRayHit.value().hit);
                         enableDebugDraw = false;
                     }
                     glPopAttrib();
@@ -161,8 +163,9 @@ int main(int argc, char** argv) {
                 case ViewMode::RayTraced: {
                     const auto start                        = std::chrono::high_resolution_clock::now();
                     screen.clear(glm::vec3(0.0f));
-                    std::optional<ReservoirGrid> maybeGrid  = renderRayTraced(previousFrameGrid, scene, camera, embreeInterface, screen, config.features);
-                    if (maybeGrid) { previousFrameGrid      = std::make_shared<ReservoirGrid>(maybeGrid.value()); }
+                    std::optional<AnyReservoirGrid> maybeGrid = renderRayTraced(previousFrameGrid, spatialSwapGrid, scene, camera, embreeInterface, screen,
+                                                                              config.features, frameIdx++);
+                    if (maybeGrid) { previousFrameGrid      = std::make_shared<AnyReservoirGrid>(maybeGrid.value()); }
                     screen.setPixel(0, 0, glm::vec3(1.0f));
                     screen.draw(); // Takes the image generated using ray tracing and outputs it to the screen using OpenGL.
                     const auto end                          = std::chrono::high_resolution_clock::now();
@@ -202,7 +205,7 @@ int main(int argc, char** argv) {
             config.scene);
 
         EmbreeInterface embreeInterface(scene);
-        std::shared_ptr<ReservoirGrid> previousFrameGrid;
+        std::shared_ptr<AnyReservoirGrid> previousFrameGrid;
 
         // Create output directory if it does not exist.
         if (!std::filesystem::exists(config.outputDir)) { std::filesystem::create_directories(config.outputDir); }
@@ -217,8 +220,10 @@ int main(int argc, char** argv) {
                 screen.clear(glm::vec3(0.0f));
                 Trackball camera { &window, glm::radians(cameraConfig.fieldOfView), cameraConfig.distanceFromLookAt };
                 camera.setCamera(cameraConfig.lookAt, glm::radians(cameraConfig.rotation), cameraConfig.distanceFromLookAt);
-                std::optional<ReservoirGrid> maybeGrid  = renderRayTraced(previousFrameGrid, scene, camera, embreeInterface, screen, config.features);
-                if (maybeGrid) { previousFrameGrid      = std::make_shared<ReservoirGrid>(maybeGrid.value()); }
+                AnyReservoirGrid spatialSwapGrid; // Per worker, as cameras render concurrently
+                std::optional<AnyReservoirGrid> maybeGrid = renderRayTraced(previousFrameGrid, spatialSwapGrid, scene, camera, embreeInterface, screen, config.features,
+                                                                          static_cast<uint32_t>(index)); // Each camera renders its own reproducible frame
+                if (maybeGrid) { previousFrameGrid      = std::make_shared<AnyReservoirGrid>(maybeGrid.value()); }
                 const auto filename_base                = fmt::format("{}_{}_cam_{}", sceneName, start_time_string, index);
                 const auto filepath                     = config.outputDir / (filename_base + ".bmp");
                 fmt::print("Image {} saved to {}\n", index, filepath.string());
@@ -2,12 +2,17 @@
 
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 DISABLE_WARNINGS_POP()
 
 #include <ui/draw.h>
 #include <utils/utils.h>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <format>
 #include <stdexcept>
 
@@ -17,7 +22,7 @@ EmbreeInterface::EmbreeInterface(const Scene& scene) {
 }
 
 EmbreeInterface::~EmbreeInterface() {
-    rtcReleaseScene(m_scene);
+    releaseScene();
     rtcReleaseDevice(m_device);
 }
 
@@ -28,30 +33,94 @@ void EmbreeInterface::initDevice() {
 }
 
 void EmbreeInterface::initScene(const Scene& scene) {
-    m_scene = rtcNewScene(m_device);
-    rtcSetSceneBuildQuality(m_scene, RTC_BUILD_QUALITY_HIGH);
-    for (const Mesh& mesh : scene.meshes) {
-        // Create and populate buffers to house vertex and triangle data
-        RTCGeometry geom    = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_TRIANGLE);
-        rtcSetGeometryVertexAttributeCount(geom, 2);
-        glm::vec3* positions    = (glm::vec3*)  rtcSetNewGeometryBuffer(geom,   RTC_BUFFER_TYPE_VERTEX,             0,  RTC_FORMAT_FLOAT3,  sizeof(glm::vec3),  mesh.vertices.size());
-        glm::vec3* normals      = (glm::vec3*)  rtcSetNewGeometryBuffer(geom,   RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,   0,  RTC_FORMAT_FLOAT3,  sizeof(glm::vec3),  mesh.vertices.size());
-        glm::vec2* texCoords    = (glm::vec2*)  rtcSetNewGeometryBuffer(geom,   RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,   1,  RTC_FORMAT_FLOAT2,  sizeof(glm::vec2),  mesh.vertices.size());
-        glm::uvec3* indices     = (glm::uvec3*) rtcSetNewGeometryBuffer(geom,   RTC_BUFFER_TYPE_INDEX,              0,  RTC_FORMAT_UINT3,   sizeof(glm::uvec3), mesh.triangles.size());
-        populateVertexDataBuffers(positions, normals, texCoords, mesh.vertices);
-        populateIndexBuffer(indices, mesh.triangles);
-
-        // Commit geometry and store its ID for material info lookup
+    // Dynamic scenes trade some traversal speed for cheap acceleration structure updates
+    m_dynamic   = scene.dynamic;
+    m_scene     = rtcNewScene(m_device);
+    if (m_dynamic)  { rtcSetSceneFlags(m_scene, RTC_SCENE_FLAG_DYNAMIC); }
+    rtcSetSceneBuildQuality(m_scene, m_dynamic ? RTC_BUILD_QUALITY_LOW : RTC_BUILD_QUALITY_HIGH);
+    m_materials = scene.materials;
+    m_geometries.clear();
+    m_instanceGeometryIds.clear();
+
+    // Meshes placed once are flattened into the top-level scene
+    for (size_t meshIdx = 0ULL; meshIdx < scene.meshes.size(); meshIdx++) {
+        RTCGeometry geom    = createTriangleGeometry(scene.meshes[meshIdx]);
+        uint32_t geomId     = rtcAttachGeometry(m_scene, geom);
+        recordGeometry(geomId, { geom, meshMaterialId(meshIdx), false, 0U, glm::identity<glm::mat4>(), glm::identity<glm::mat3>() });
+        rtcReleaseGeometry(geom);
+    }
+
+    // Instanced meshes are built once into their own BVH...
+    for (const Mesh& mesh : scene.instancedMeshes) {
+        RTCScene prototypeScene = rtcNewScene(m_device);
+        if (m_dynamic)  { rtcSetSceneFlags(prototypeScene, RTC_SCENE_FLAG_DYNAMIC); }
+        rtcSetSceneBuildQuality(prototypeScene, RTC_BUILD_QUALITY_HIGH);
+        RTCGeometry geom        = createTriangleGeometry(mesh);
+        rtcAttachGeometry(prototypeScene, geom);
+        rtcReleaseGeometry(geom);
+        rtcCommitScene(prototypeScene);
+        m_prototypeScenes.push_back(prototypeScene);
+        m_prototypeGeometries.push_back(geom);
+    }
+
+    // ...and placed in the top-level scene by reference
+    for (const MeshInstance& instance : scene.instances) {
+        RTCGeometry geom = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_INSTANCE);
+        rtcSetGeometryInstancedScene(geom, m_prototypeScenes[instance.meshIdx]);
+        rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, glm::value_ptr(instance.transform));
         rtcCommitGeometry(geom);
-        uint32_t geomId             = rtcAttachGeometry(m_scene, geom);
-        m_meshToMaterial[geomId]    = mesh.material;
+        uint32_t geomId = rtcAttachGeometry(m_scene, geom);
+        recordGeometry(geomId, { m_prototypeGeometries[instance.meshIdx], instancedMeshMaterialId(scene, instance.meshIdx), true, instance.meshIdx,
+                                 instance.transform, glm::inverseTranspose(glm::mat3(instance.transform)) });
+        m_instanceGeometryIds.push_back(geomId);
         rtcReleaseGeometry(geom);
     }
     rtcCommitScene(m_scene);
+
+    // Nothing is dirty straight after a full build
+    m_dirtyGeometries.assign(m_geometries.size(), 0U);
+    m_dirtyPrototypes.assign(m_prototypeScenes.size(), 0U);
 }
 
-void EmbreeInterface::changeScene(const Scene& scene) {
+void EmbreeInterface::releaseScene() {
     rtcReleaseScene(m_scene);
+    for (RTCScene prototypeScene : m_prototypeScenes) { rtcReleaseScene(prototypeScene); }
+    m_prototypeScenes.clear();
+    m_prototypeGeometries.clear();
+}
+
+RTCGeometry EmbreeInterface::createTriangleGeometry(const Mesh& mesh) {
+    // Bind the mesh's interleaved vertex and index storage directly instead of copying it
+    RTCGeometry geom                = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_TRIANGLE);
+    const size_t numVertices        = mesh.vertices.size();
+    const Vertex* vertices          = mesh.vertices.data();
+    rtcSetGeometryVertexAttributeCount(geom, 2);
+    rtcSetSharedGeometryBuffer(geom,    RTC_BUFFER_TYPE_VERTEX,             0,  RTC_FORMAT_FLOAT3,  vertices,               offsetof(Vertex, position), sizeof(Vertex),     numVertices);
+    rtcSetSharedGeometryBuffer(geom,    RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,   0,  RTC_FORMAT_FLOAT3,  vertices,               offsetof(Vertex, normal),   sizeof(Vertex),     numVertices);
+    rtcSetSharedGeometryBuffer(geom,    RTC_BUFFER_TYPE_INDEX,              0,  RTC_FORMAT_UINT3,   mesh.triangles.data(),  0ULL,                       sizeof(glm::uvec3), mesh.triangles.size());
+
+    // The 16 byte load Embree uses on the last element of a vertex buffer runs past the final texture coordinate,
+    // which is only safe if the vertex storage has spare capacity (see loadMesh). Otherwise, fall back to a copy
+    if (mesh.vertices.capacity() > numVertices) {
+        rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, RTC_FORMAT_FLOAT2, vertices, offsetof(Vertex, texCoord), sizeof(Vertex), numVertices);
+    } else {
+        glm::vec2* texCoords = (glm::vec2*) rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, RTC_FORMAT_FLOAT2, sizeof(glm::vec2), numVertices);
+        populateTexCoordBuffer(texCoords, mesh.vertices);
+    }
+
+    // Geometry of dynamic scenes may deform, in which case its BVH is refit instead of rebuilt
+    if (m_dynamic) { rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_REFIT); }
+    rtcCommitGeometry(geom);
+    return geom;
+}
+
+void EmbreeInterface::recordGeometry(uint32_t geomId, const GeometryRecord& record) {
+    if (geomId >= m_geometries.size()) { m_geometries.resize(geomId + 1U); }
+    m_geometries[geomId] = record;
+}
+
+void EmbreeInterface::changeScene(const Scene& scene) {
+    releaseScene();
     initScene(scene);
 }
 
@@ -61,6 +130,7 @@ bool EmbreeInterface::anyHit(Ray& ray) const {
     return rayhit.ray.tfar == -std::numeric_limits<float>::infinity(); // Tfar is set to -inf if any hit is detected
 }
 
+template <typename DebugDraw>
 bool EmbreeInterface::closestHit(Ray& ray, HitInfo& hitInfo) const {
     // Construct Embree ray and carry out intersection test
     RTCRayHit rayhit = constructEmbreeRay(ray);
@@ -68,40 +138,161 @@ bool EmbreeInterface::closestHit(Ray& ray, HitInfo& hitInfo) const {
 
     // No intersection: draw no hit debug ray and return false
     if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID) {
-        drawRay(ray, CAMERA_RAY_NO_HIT_COLOR);
+        if constexpr (DebugDraw::enabled) { drawRay(ray, CAMERA_RAY_NO_HIT_COLOR); }
         return false;
     };
 
     // Intersection: update hit info and user ray
-    rtcInterpolate0(rtcGetGeometry(m_scene, rayhit.hit.geomID), rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v,
-                    RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,   0, glm::value_ptr(hitInfo.normal),              3);
-    rtcInterpolate0(rtcGetGeometry(m_scene, rayhit.hit.geomID), rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v,
-                    RTC_BUFFER_TYPE_VERTEX,             0, glm::value_ptr(hitInfo.barycentricCoord),    3);
-    rtcInterpolate0(rtcGetGeometry(m_scene, rayhit.hit.geomID), rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v,
-                    RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,   1, glm::value_ptr(hitInfo.texCoord),            2);
-    hitInfo.material    = m_meshToMaterial.at(rayhit.hit.geomID);
-    hitInfo.geometryId  = rayhit.hit.geomID;
-    ray.t               = rayhit.ray.tfar;
+    recordHit(rayhit.hit.geomID, rayhit.hit.primID, rayhit.hit.instID[0], rayhit.hit.u, rayhit.hit.v, hitInfo);
+    resolveHitAttributes(hitInfo);
+    ray.t = rayhit.ray.tfar;
 
     // Debug draw ray and normal, then return true
-    drawRay(ray, CAMERA_RAY_HIT_COLOR);
-    drawRay({ray.origin + (ray.t * ray.direction), hitInfo.normal, 1.0f}, hitInfo.material.kd);
+    if constexpr (DebugDraw::enabled) {
+        drawRay(ray, CAMERA_RAY_HIT_COLOR);
+        drawRay({ray.origin + (ray.t * ray.direction), hitInfo.normal, 1.0f}, m_materials[hitInfo.materialId].kd);
+    }
     return true;
 }
+template bool EmbreeInterface::closestHit<DebugDrawOff>(Ray& ray, HitInfo& hitInfo) const;
+template bool EmbreeInterface::closestHit<DebugDrawOn>(Ray& ray, HitInfo& hitInfo) const;
+
+template <typename DebugDraw>
+void EmbreeInterface::closestHitPacket(std::span<RayHit> rayHits) const {
+    // Camera rays of neighbouring pixels traverse near-identical BVH paths
+    RTCIntersectArguments args;
+    rtcInitIntersectArguments(&args);
+    args.flags = RTC_RAY_QUERY_FLAG_COHERENT;
+
+    for (size_t packetStart = 0ULL; packetStart < rayHits.size(); packetStart += PACKET_SIZE) {
+        // Construct packet, masking out lanes past the end of the batch
+        const size_t packetCount = std::min(PACKET_SIZE, rayHits.size() - packetStart);
+        alignas(32) std::array<int, PACKET_SIZE> valid;
+        RTCRayHit8 packet;
+        for (size_t lane = 0ULL; lane < PACKET_SIZE; lane++) {
+            valid[lane] = lane < packetCount ? -1 : 0;
+            if (lane < packetCount) { setPacketRay(packet, lane, rayHits[packetStart + lane].ray); }
+        }
+        rtcIntersect8(valid.data(), m_scene, &packet, &args);
+
+        // Scatter results back to the individual rays
+        for (size_t lane = 0ULL; lane < packetCount; lane++) {
+            RayHit& rayHit = rayHits[packetStart + lane];
+            if (packet.hit.geomID[lane] == RTC_INVALID_GEOMETRY_ID) {
+                if constexpr (DebugDraw::enabled) { drawRay(rayHit.ray, CAMERA_RAY_NO_HIT_COLOR); }
+                continue;
+            }
+            recordHit(packet.hit.geomID[lane], packet.hit.primID[lane], packet.hit.instID[0][lane], packet.hit.u[lane], packet.hit.v[lane], rayHit.hit);
+            rayHit.ray.t = packet.ray.tfar[lane];
+            if constexpr (DebugDraw::enabled) {
+                resolveHitAttributes(rayHit.hit);
+                drawRay(rayHit.ray, CAMERA_RAY_HIT_COLOR);
+                drawRay({rayHit.ray.origin + (rayHit.ray.t * rayHit.ray.direction), rayHit.hit.normal, 1.0f}, m_materials[rayHit.hit.materialId].kd);
+            }
+        }
+    }
+}
+template void EmbreeInterface::closestHitPacket<DebugDrawOff>(std::span<RayHit> rayHits) const;
+template void EmbreeInterface::closestHitPacket<DebugDrawOn>(std::span<RayHit> rayHits) const;
+
+void EmbreeInterface::anyHitPacket(std::span<const Ray> rays, std::span<uint8_t> occluded) const {
+    for (size_t packetStart = 0ULL; packetStart < rays.size(); packetStart += PACKET_SIZE) {
+        // Construct packet, masking out lanes past the end of the batch
+        const size_t packetCount = std::min(PACKET_SIZE, rays.size() - packetStart);
+        alignas(32) std::array<int, PACKET_SIZE> valid;
+        RTCRay8 packet;
+        for (size_t lane = 0ULL; lane < PACKET_SIZE; lane++) {
+            valid[lane] = lane < packetCount ? -1 : 0;
+            if (lane < packetCount) { setPacketRay(packet, lane, rays[packetStart + lane]); }
+        }
+        rtcOccluded8(valid.data(), m_scene, &packet);
+
+        // Tfar is set to -inf for each ray with any hit
+        for (size_t lane = 0ULL; lane < packetCount; lane++) {
+            occluded[packetStart + lane] = packet.tfar[lane] == -std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
+void EmbreeInterface::setInstanceTransform(size_t instanceIdx, const glm::mat4& transform) {
+    requireDynamic();
+    const uint32_t geomId   = m_instanceGeometryIds.at(instanceIdx);
+    GeometryRecord& record  = m_geometries[geomId];
+    record.objectToWorld    = transform;
+    record.normalToWorld    = glm::inverseTranspose(glm::mat3(transform));
+    rtcSetGeometryTransform(rtcGetGeometry(m_scene, geomId), 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, glm::value_ptr(transform));
+    m_dirtyGeometries[geomId] = 1U;
+}
 
-void EmbreeInterface::populateVertexDataBuffers(glm::vec3* positionBuffer, glm::vec3* normalBuffer, glm::vec2* texCoordBuffer,
-                                                const std::vector<Vertex>& vertices) {
-    for (size_t vertexIdx = 0ULL; vertexIdx < vertices.size(); vertexIdx++) {
-        positionBuffer[vertexIdx]   = vertices[vertexIdx].position;
-        normalBuffer[vertexIdx]     = vertices[vertexIdx].normal;
-        texCoordBuffer[vertexIdx]   = vertices[vertexIdx].texCoord;
+void EmbreeInterface::updateInstancedMeshVertices(Scene& scene, size_t meshIdx, std::span<const Vertex> vertices) {
+    requireDynamic();
+    std::vector<Vertex>& meshVertices = scene.instancedMeshes.at(meshIdx).vertices;
+    if (vertices.size() != meshVertices.size()) {
+        throw std::runtime_error(std::format("Deformed mesh {} has {} vertices, but its geometry buffers hold {}", meshIdx, vertices.size(), meshVertices.size()));
     }
+    std::copy(vertices.begin(), vertices.end(), meshVertices.begin());
+    updateVertexData(m_prototypeGeometries.at(meshIdx));
+    m_dirtyPrototypes[meshIdx] = 1U;
 }
 
-void EmbreeInterface::populateIndexBuffer(glm::uvec3* indexBuffer, const std::vector<glm::uvec3>& indices) {
-    for (size_t triangleIdx = 0ULL; triangleIdx < indices.size(); triangleIdx++) {
-        indexBuffer[triangleIdx] = indices[triangleIdx];
+void EmbreeInterface::commitUpdates() {
+    // Refit deformed instanced meshes. Instances of them must be re-committed to pick up their new bounds
+    for (size_t prototypeIdx = 0ULL; prototypeIdx < m_prototypeScenes.size(); prototypeIdx++) {
+        if (!m_dirtyPrototypes[prototypeIdx]) { continue; }
+        rtcCommitGeometry(m_prototypeGeometries[prototypeIdx]);
+        rtcCommitScene(m_prototypeScenes[prototypeIdx]);
+        for (uint32_t geomId : m_instanceGeometryIds) {
+            if (m_geometries[geomId].prototypeIdx == prototypeIdx) { m_dirtyGeometries[geomId] = 1U; }
+        }
+        m_dirtyPrototypes[prototypeIdx] = 0U;
     }
+
+    // Re-commit changed top-level geometries, then update the top-level BVH only if any of them changed
+    bool topLevelDirty = false;
+    for (uint32_t geomId = 0U; geomId < m_dirtyGeometries.size(); geomId++) {
+        if (!m_dirtyGeometries[geomId]) { continue; }
+        rtcCommitGeometry(rtcGetGeometry(m_scene, geomId));
+        m_dirtyGeometries[geomId]   = 0U;
+        topLevelDirty               = true;
+    }
+    if (topLevelDirty) { rtcCommitScene(m_scene); }
+}
+
+void EmbreeInterface::requireDynamic() const {
+    if (!m_dynamic) { throw std::runtime_error("Incremental updates are only supported for dynamic scenes"); }
+}
+
+void EmbreeInterface::updateVertexData(RTCGeometry geom) {
+    // Buffers are shared with the deformed mesh, so only flag them as modified. Deformation leaves texture coordinates untouched
+    rtcUpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX,           0);
+    rtcUpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0);
+}
+
+void EmbreeInterface::populateTexCoordBuffer(glm::vec2* texCoordBuffer, const std::vector<Vertex>& vertices) {
+    for (size_t vertexIdx = 0ULL; vertexIdx < vertices.size(); vertexIdx++) { texCoordBuffer[vertexIdx] = vertices[vertexIdx].texCoord; }
+}
+
+void EmbreeInterface::recordHit(uint32_t geomId, uint32_t primId, uint32_t instId, float u, float v, HitInfo& hitInfo) const {
+    // Hits on instances report the instanced geometry's ID within its prototype scene, so identify them by their instance ID
+    const uint32_t topLevelId   = instId == RTC_INVALID_GEOMETRY_ID ? geomId : instId;
+    hitInfo.geometryId          = topLevelId;
+    hitInfo.primitiveId         = primId;
+    hitInfo.barycentricCoord    = { u, v };
+    hitInfo.materialId          = m_geometries[topLevelId].materialId;
+}
+
+void EmbreeInterface::resolveHitAttributes(HitInfo& hitInfo) const {
+    if (hitInfo.materialId == MISS_MATERIAL_ID) { return; }
+    const GeometryRecord& record    = m_geometries[hitInfo.geometryId];
+    const float u                   = hitInfo.barycentricCoord.x;
+    const float v                   = hitInfo.barycentricCoord.y;
+    rtcInterpolate0(record.triangles, hitInfo.primitiveId, u, v, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, glm::value_ptr(hitInfo.normal), 3);
+    if (record.instanced)                           { hitInfo.normal = glm::normalize(record.normalToWorld * hitInfo.normal); }
+    if (m_materials[hitInfo.materialId].kdTexture)  { rtcInterpolate0(record.triangles, hitInfo.primitiveId, u, v, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 1, glm::value_ptr(hitInfo.texCoord), 2); }
+}
+
+void EmbreeInterface::resolveHitAttributes(std::span<RayHit> rayHits) const {
+    for (RayHit& rayHit : rayHits) { resolveHitAttributes(rayHit.hit); }
 }
 
 RTCRayHit EmbreeInterface::constructEmbreeRay(const Ray& ray) const {
@@ -120,3 +311,31 @@ RTCRayHit EmbreeInterface::constructEmbreeRay(const Ray& ray) const {
     rayhit.hit.instID[0]    = RTC_INVALID_GEOMETRY_ID;
     return rayhit;
 }
+
+void EmbreeInterface::setPacketRay(RTCRayHit8& packet, size_t lane, const Ray& ray) const {
+    packet.ray.org_x[lane]      = ray.origin.x;
+    packet.ray.org_y[lane]      = ray.origin.y;
+    packet.ray.org_z[lane]      = ray.origin.z;
+    packet.ray.dir_x[lane]      = ray.direction.x;
+    packet.ray.dir_y[lane]      = ray.direction.y;
+    packet.ray.dir_z[lane]      = ray.direction.z;
+    packet.ray.tnear[lane]      = 0.0f;
+    packet.ray.tfar[lane]       = ray.t;
+    packet.ray.mask[lane]       = -1;
+    packet.ray.flags[lane]      = 0;
+    packet.hit.geomID[lane]     = RTC_INVALID_GEOMETRY_ID;
+    packet.hit.instID[0][lane]  = RTC_INVALID_GEOMETRY_ID;
+}
+
+void EmbreeInterface::setPacketRay(RTCRay8& packet, size_t lane, const Ray& ray) const {
+    packet.org_x[lane]  = ray.origin.x;
+    packet.org_y[lane]  = ray.origin.y;
+    packet.org_z[lane]  = ray.origin.z;
+    packet.dir_x[lane]  = ray.direction.x;
+    packet.dir_y[lane]  = ray.direction.y;
+    packet.dir_z[lane]  = ray.direction.z;
+    packet.tnear[lane]  = 0.0f;
+    packet.tfar[lane]   = ray.t;
+    packet.mask[lane]   = -1;
+    packet.flags[lane]  = 0;
+}
@@ -4,34 +4,113 @@
 
 #include <embree4/rtcore.h>
 
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+DISABLE_WARNINGS_POP()
+
 #include <scene/scene.h>
+#include <ui/draw.h>
 
-#include <unordered_map>
+#include <span>
+#include <vector>
 
 
 class EmbreeInterface {
 public:
+    // Number of rays traced together by the packet entry points
+    static constexpr size_t PACKET_SIZE = 8ULL;
+
+    // Mesh vertex and index storage is bound without copying, so the scene must outlive its use by the interface
     EmbreeInterface(const Scene& scene);
     ~EmbreeInterface();
 
     void changeScene(const Scene& scene);
     bool anyHit(Ray& ray) const;
+    template <typename DebugDraw = DebugDrawOff>
     bool closestHit(Ray& ray, HitInfo& hitInfo) const;
 
+    /**
+     * Find the closest hit of a batch of coherent rays (e.g. camera rays of neighbouring pixels) using packet traversal.
+     * Only the raw hit records are stored, surface attributes need to be resolved afterwards with resolveHitAttributes
+     * 
+     * @param rayHits Rays to trace. The hit info and ray distance of each ray that intersects the scene are updated in place
+    */
+    template <typename DebugDraw = DebugDrawOff>
+    void closestHitPacket(std::span<RayHit> rayHits) const;
+
+    /**
+     * Test a batch of rays for any intersection using packet traversal
+     * 
+     * @param rays Rays to trace
+     * @param occluded Output flags, one per ray. Set to 1 if the corresponding ray hits anything, 0 otherwise
+    */
+    void anyHitPacket(std::span<const Ray> rays, std::span<uint8_t> occluded) const;
+
+    // Interpolate the surface attributes of raw hit records. Misses are skipped, as are texture coordinates of untextured materials
+    void resolveHitAttributes(HitInfo& hitInfo) const;
+    void resolveHitAttributes(std::span<RayHit> rayHits) const;
+
+    // Incremental updates of dynamic scenes (Scene::dynamic, see makeSceneDynamic). Changes are only marked dirty here and
+    // applied by commitUpdates()
+    void setInstanceTransform(size_t instanceIdx, const glm::mat4& transform);
+
+    /**
+     * Deform an instanced mesh, affecting all of its instances. Geometry buffers are shared with the scene, so the new
+     * vertices are copied into the mesh's existing vertex storage, whose size cannot change
+     * 
+     * @param scene Scene the interface was built from
+     * @param meshIdx Index into Scene::instancedMeshes
+     * @param vertices New vertices, as many as the mesh has. Texture coordinates are not updated
+    */
+    void updateInstancedMeshVertices(Scene& scene, size_t meshIdx, std::span<const Vertex> vertices);
+
+    /**
+     * Re-commit only the geometries changed since the last commit. Deformed meshes are refit rather than rebuilt,
+     * and the top-level BVH is only updated if anything in it changed
+    */
+    void commitUpdates();
+
 private:
     static constexpr glm::vec3 CAMERA_RAY_HIT_COLOR        = {0.0f, 1.0f, 0.0f};
     static constexpr glm::vec3 CAMERA_RAY_NO_HIT_COLOR     = {1.0f, 0.0f, 0.0f};
 
+    // Per top-level geometry info needed to resolve hits, indexed by top-level geometry ID
+    struct GeometryRecord {
+        RTCGeometry triangles;      // Triangle geometry holding the vertex attributes. Kept alive by the scene it is attached to
+        uint32_t materialId;
+        bool instanced;
+        uint32_t prototypeIdx;      // Only used by instances
+        glm::mat4 objectToWorld;    // Only used by instances
+        glm::mat3 normalToWorld;    // Only used by instances
+    };
+
     void initDevice();
     void initScene(const Scene& scene);
-    void populateVertexDataBuffers(glm::vec3* positionBuffer, glm::vec3* normalBuffer, glm::vec2* texCoordBuffer,
-                                   const std::vector<Vertex>& vertices);
-    void populateIndexBuffer(glm::uvec3* indexBuffer, const std::vector<glm::uvec3>& indices);
+    void releaseScene();
+    RTCGeometry createTriangleGeometry(const Mesh& mesh);
+    void recordGeometry(uint32_t geomId, const GeometryRecord& record);
+    void requireDynamic() const;
+    void updateVertexData(RTCGeometry geom);
+    void populateTexCoordBuffer(glm::vec2* texCoordBuffer, const std::vector<Vertex>& vertices);
+    void recordHit(uint32_t geomId, uint32_t primId, uint32_t instId, float u, float v, HitInfo& hitInfo) const;
     RTCRayHit constructEmbreeRay(const Ray& ray) const;
+    void setPacketRay(RTCRayHit8& packet, size_t lane, const Ray& ray) const;
+    void setPacketRay(RTCRay8& packet, size_t lane, const Ray& ray) const;
 
     RTCDevice m_device;
     RTCScene m_scene;
-    std::unordered_map<uint32_t, Material> m_meshToMaterial;
+    std::vector<RTCScene> m_prototypeScenes;        // One BVH per instanced mesh, shared by all of its instances
+    std::vector<RTCGeometry> m_prototypeGeometries;
+    std::vector<GeometryRecord> m_geometries;
+    std::vector<uint32_t> m_instanceGeometryIds;    // Top-level geometry ID of each instance
+
+    // Dynamic scene state
+    bool m_dynamic;
+    std::vector<uint8_t> m_dirtyGeometries;         // Indexed by top-level geometry ID
+    std::vector<uint8_t> m_dirtyPrototypes;
+    std::span<const Material> m_materials;      // Scene material table, used for debug drawing
 };
 
 
@@ -0,0 +1,69 @@
+#include "shadow_ray_queue.h"
+
+#include <ui/draw.h>
+#include <utils/utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+
+ShadowRayQueue::ShadowRayQueue(const EmbreeInterface& embreeInterface, bool coherenceSort) : m_embreeInterface(embreeInterface)
+                                                                                           , m_coherenceSort(coherenceSort) {}
+
+// Bin a direction by octant, then by a coarse 8x8 grid over its x and y magnitudes within the octant
+static uint32_t directionBin(const glm::vec3& direction) {
+    const uint32_t octant   = (direction.x < 0.0f ? 1U : 0U) | (direction.y < 0.0f ? 2U : 0U) | (direction.z < 0.0f ? 4U : 0U);
+    const uint32_t binX     = std::min(static_cast<uint32_t>(std::abs(direction.x) * 8.0f), 7U);
+    const uint32_t binY     = std::min(static_cast<uint32_t>(std::abs(direction.y) * 8.0f), 7U);
+    return (octant << 6U) | (binX << 3U) | binY;
+}
+
+size_t ShadowRayQueue::enqueue(const glm::vec3& samplePos, const glm::vec3& shadingPos) {
+    m_shadowRays.push_back(constructShadowRay(samplePos, shadingPos));
+    return m_shadowRays.size() - 1ULL;
+}
+
+template <typename DebugDraw>
+void ShadowRayQueue::flush() {
+    if (m_numFlushed == m_shadowRays.size()) { return; }
+
+    // Trace all queries made since the last flush
+    m_occluded.resize(m_shadowRays.size());
+    if (m_coherenceSort) {
+        // Queries are made in raster order, so consecutive windows of them approximate origin tiles. Within each window,
+        // group rays by direction (and thus target light) so packets traverse similar BVH nodes. Slot order breaks ties
+        constexpr uint64_t slotMask = 0xFFFFFFFFULL;
+        m_sortKeys.clear();
+        for (size_t slot = m_numFlushed; slot < m_shadowRays.size(); slot++) {
+            const uint64_t originTile = slot / COHERENCE_WINDOW;
+            m_sortKeys.push_back((originTile << 41ULL) | (static_cast<uint64_t>(directionBin(m_shadowRays[slot].direction)) << 32ULL) | slot);
+        }
+        std::sort(m_sortKeys.begin(), m_sortKeys.end());
+
+        // Trace in sorted order and un-permute the results back to their slots
+        m_sortedRays.clear();
+        for (uint64_t key : m_sortKeys) { m_sortedRays.push_back(m_shadowRays[key & slotMask]); }
+        m_sortedOccluded.resize(m_sortedRays.size());
+        m_embreeInterface.anyHitPacket(m_sortedRays, m_sortedOccluded);
+        for (size_t sortedIdx = 0ULL; sortedIdx < m_sortKeys.size(); sortedIdx++) { m_occluded[m_sortKeys[sortedIdx] & slotMask] = m_sortedOccluded[sortedIdx]; }
+    } else {
+        m_embreeInterface.anyHitPacket(std::span(m_shadowRays).subspan(m_numFlushed), std::span(m_occluded).subspan(m_numFlushed));
+    }
+
+    // Debug rays
+    if constexpr (DebugDraw::enabled) {
+        for (size_t slot = m_numFlushed; slot < m_shadowRays.size(); slot++) {
+            drawRay(m_shadowRays[slot], m_occluded[slot] ? SHADOW_RAY_INTERSECT_COLOR : SHADOW_RAY_NO_HIT_COLOR);
+        }
+    }
+    m_numFlushed = m_shadowRays.size();
+}
+template void ShadowRayQueue::flush<DebugDrawOff>();
+template void ShadowRayQueue::flush<DebugDrawOn>();
+
+void ShadowRayQueue::clear() {
+    m_shadowRays.clear();
+    m_occluded.clear();
+    m_numFlushed = 0ULL;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef _SHADOW_RAY_QUEUE_H_
+#define _SHADOW_RAY_QUEUE_H_
+
+#include <ray_tracing/embree_interface.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <framework/ray.h>
+
+#include <vector>
+
+
+/**
+ * Collects light sample visibility tests so they can be traced together in SIMD packets instead of one ray at a time.
+ * Queries are enqueued with a result slot, traced by flush(), and their results read back through the slot.
+ * Intended to be used by a single thread (e.g. one queue per row of a parallel pass)
+*/
+class ShadowRayQueue {
+public:
+    // Number of consecutively queued rays treated as sharing an origin tile when sorting by coherence
+    static constexpr size_t COHERENCE_WINDOW = 256ULL;
+
+    /**
+     * @param embreeInterface Interface used to trace the queued rays
+     * @param coherenceSort Reorder pending rays by origin tile and direction before tracing them (results are still read back by slot)
+    */
+    ShadowRayQueue(const EmbreeInterface& embreeInterface, bool coherenceSort = false);
+
+    /**
+     * Queue a visibility test between a shading point and a light sample
+     * 
+     * @param samplePos Position of the light sample
+     * @param shadingPos Position of the shading point (e.g. from the G-buffer)
+     * 
+     * @return Slot from which the visibility of the sample can be read after the next flush
+    */
+    size_t enqueue(const glm::vec3& samplePos, const glm::vec3& shadingPos);
+
+    // Trace all pending queries and scatter their results to their slots
+    template <typename DebugDraw = DebugDrawOff>
+    void flush();
+
+    // Visibility of the light sample queued in the given slot. Only valid after the slot has been flushed
+    bool visible(size_t slot) const { return !m_occluded[slot]; }
+
+    // Discard all queries and results, starting slot numbering anew
+    void clear();
+
+    size_t size() const { return m_shadowRays.size(); }
+
+private:
+    const EmbreeInterface& m_embreeInterface;
+    std::vector<Ray> m_shadowRays;
+    std::vector<uint8_t> m_occluded;
+    size_t m_numFlushed = 0ULL;
+
+    // Coherence sorting (scratch buffers kept to be reused across flushes)
+    bool m_coherenceSort;
+    std::vector<uint64_t> m_sortKeys;
+    std::vector<Ray> m_sortedRays;
+    std::vector<uint8_t> m_sortedOccluded;
+};
+
+
+#endif // _SHADOW_RAY_QUEUE_H_
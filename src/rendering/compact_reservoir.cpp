@@ -0,0 +1,31 @@
+#include "compact_reservoir.h"
+
+#include <scene/light.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr float UNORM16_MAX = static_cast<float>(std::numeric_limits<uint16_t>::max());
+
+CompactSample compactSample(const LightSample& sample, float outputWeight, size_t sampleNum, const Scene& scene) {
+    const glm::vec2 coordinates = lightSampleCoordinates(scene, sample);
+    return { sample.lightIdx,
+             static_cast<uint16_t>(std::round(coordinates.x * UNORM16_MAX)),
+             static_cast<uint16_t>(std::round(coordinates.y * UNORM16_MAX)),
+             outputWeight,
+             static_cast<uint16_t>(std::min<size_t>(sampleNum, std::numeric_limits<uint16_t>::max())) };
+}
+
+SampleData expandSample(const CompactSample& sample, const Scene& scene) {
+    if (sample.lightIdx >= scene.lightBuffer.size()) { return SampleData {}; }
+    SampleData expanded;
+    expanded.lightSample    = lightSampleAt(scene, sample.lightIdx, glm::vec2(sample.u, sample.v) / UNORM16_MAX);
+    expanded.outputWeight   = sample.outputWeight;
+    return expanded;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef _COMPACT_RESERVOIR_H_
+#define _COMPACT_RESERVOIR_H_
+
+#include <rendering/reservoir.h>
+#include <scene/scene.h>
+#include <utils/common.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Sub-reservoir packed in 16 bytes, holding only what reservoirs need as inputs of a combination. The sample is stored as
+ * its light and unorm16 coordinates along the light's edges, from which position and color are re-derived. Cached target
+ * function values, weight sums and chosen sample weights are not kept
+*/
+struct CompactSample {
+    uint32_t lightIdx;
+    uint16_t u, v;
+    float outputWeight;
+    uint16_t sampleNum; // Saturates at the largest representable count
+};
+static_assert(sizeof(CompactSample) == 16ULL, "Compact samples should stay 16 bytes");
+
+CompactSample compactSample(const LightSample& sample, float outputWeight, size_t sampleNum, const Scene& scene);
+
+// Samples on lights which no longer exist in the scene come back with a zero output weight
+SampleData expandSample(const CompactSample& sample, const Scene& scene);
+
+/**
+ * Reservoirs of a whole frame in compact form, e.g. as temporal history. Independent of reservoir capacity: sub-reservoir
+ * i of the pixel with index p lives at p * numSamples + i. Loaded reservoirs reference the shading point of the pixel they
+ * are loaded from
+*/
+struct CompactReservoirGrid {
+    glm::ivec2 resolution;
+    size_t numSamples;
+    std::vector<TargetFunction> targetFunctions;
+    std::vector<CompactSample> samples;
+
+    size_t pixelIndex(int x, int y) const { return (static_cast<size_t>(y) * static_cast<size_t>(resolution.x)) + static_cast<size_t>(x); }
+
+    template <size_t Capacity>
+    Reservoir<Capacity> load(int x, int y, const Scene& scene) const {
+        const size_t pixelIdx = pixelIndex(x, y);
+        Reservoir<Capacity> reservoir(numSamples);
+        reservoir.pixelIdx          = static_cast<uint32_t>(pixelIdx);
+        reservoir.targetFunction    = targetFunctions[pixelIdx];
+        for (size_t sampleIdx = 0ULL; sampleIdx < numSamples; sampleIdx++) {
+            const CompactSample& sample         = samples[(pixelIdx * numSamples) + sampleIdx];
+            reservoir.outputSamples[sampleIdx]  = expandSample(sample, scene);
+            reservoir.sampleNums[sampleIdx]     = sample.sampleNum;
+        }
+        return reservoir;
+    }
+};
+
+#endif // _COMPACT_RESERVOIR_H_
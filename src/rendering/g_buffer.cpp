@@ -0,0 +1,55 @@
+#include "g_buffer.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cmath>
+
+static glm::vec2 signNotZero(const glm::vec2& value) { return { value.x >= 0.0f ? 1.0f : -1.0f, value.y >= 0.0f ? 1.0f : -1.0f }; }
+
+uint32_t encodeOctahedral(const glm::vec3& direction) {
+    // Project onto the octahedron, then fold the lower hemisphere over the upper one's diagonals
+    const float l1Norm  = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    glm::vec2 projected = l1Norm > 0.0f ? glm::vec2(direction.x, direction.y) / l1Norm : glm::vec2(0.0f);
+    if (direction.z < 0.0f) { projected = (1.0f - glm::abs(glm::vec2(projected.y, projected.x))) * signNotZero(projected); }
+
+    const glm::ivec2 quantized = glm::ivec2(glm::round(glm::clamp(projected, -1.0f, 1.0f) * 32767.0f));
+    return (static_cast<uint32_t>(static_cast<uint16_t>(quantized.y)) << 16U) | static_cast<uint32_t>(static_cast<uint16_t>(quantized.x));
+}
+
+glm::vec3 decodeOctahedral(uint32_t encoded) {
+    const glm::vec2 projected   = glm::vec2(static_cast<float>(static_cast<int16_t>(encoded & 0xFFFFU)),
+                                            static_cast<float>(static_cast<int16_t>(encoded >> 16U))) / 32767.0f;
+    glm::vec3 direction         = glm::vec3(projected, 1.0f - std::abs(projected.x) - std::abs(projected.y));
+    if (direction.z < 0.0f) {
+        const glm::vec2 unfolded = (1.0f - glm::abs(glm::vec2(projected.y, projected.x))) * signNotZero(projected);
+        direction.x = unfolded.x;
+        direction.y = unfolded.y;
+    }
+    return glm::normalize(direction);
+}
+
+ShadingPoint GBuffer::shadingPoint(size_t pixelIdx) const {
+    return { .position          = positions[pixelIdx],
+             .normal            = normal(pixelIdx),
+             .viewDirection     = viewDirections[pixelIdx],
+             .diffuseColor      = diffuseColors[pixelIdx],
+             .specularColor     = specularColors[pixelIdx],
+             .shininess         = shininesses[pixelIdx],
+             .enableShading     = enableShading };
+}
+
+void GBuffer::store(size_t pixelIdx, const RayHit& primaryHit, const Scene& scene, const Features& features) {
+    const ShadingPoint shadingPoint = makeShadingPoint(primaryHit.ray, primaryHit.hit, scene.materials[primaryHit.hit.materialId], features);
+    positions[pixelIdx]             = shadingPoint.position;
+    depths[pixelIdx]                = primaryHit.ray.t;
+    viewDirections[pixelIdx]        = shadingPoint.viewDirection;
+    diffuseColors[pixelIdx]         = shadingPoint.diffuseColor;
+    specularColors[pixelIdx]        = shadingPoint.specularColor;
+    shininesses[pixelIdx]           = shadingPoint.shininess;
+    if (octahedralNormals)  { encodedNormals[pixelIdx]  = encodeOctahedral(shadingPoint.normal); }
+    else                    { normals[pixelIdx]         = shadingPoint.normal; }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef _G_BUFFER_H_
+#define _G_BUFFER_H_
+
+#include <rendering/shading.h>
+#include <scene/scene.h>
+#include <utils/common.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <vector>
+
+// Unit vector packed as snorm16 coordinates of its octahedral projection, and back
+uint32_t encodeOctahedral(const glm::vec3& direction);
+glm::vec3 decodeOctahedral(uint32_t encoded);
+
+/**
+ * Shading point of every pixel's primary hit in structure-of-arrays form, resolved once per frame so target function
+ * evaluations only do light-dependent work. Reservoirs reference it by pixel index. Normals are optionally kept
+ * octahedral-encoded in 4 bytes instead of 12, at the cost of a decode per lookup
+*/
+struct GBuffer {
+    GBuffer(const glm::ivec2& frameResolution, const Features& features)
+        : resolution(frameResolution)
+        , octahedralNormals(features.octahedralNormals)
+        , enableShading(features.enableShading)
+        , positions(numPixels())
+        , normals(octahedralNormals ? 0ULL : numPixels())
+        , encodedNormals(octahedralNormals ? numPixels() : 0ULL)
+        , depths(numPixels())
+        , viewDirections(numPixels())
+        , diffuseColors(numPixels())
+        , specularColors(numPixels())
+        , shininesses(numPixels()) {}
+
+    glm::ivec2 resolution;
+    bool octahedralNormals;
+    bool enableShading;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;         // Empty if normals are octahedral-encoded
+    std::vector<uint32_t> encodedNormals;   // Empty otherwise
+    std::vector<float> depths;              // Distance along the camera ray
+    std::vector<glm::vec3> viewDirections;
+    std::vector<glm::vec3> diffuseColors;   // Texture fetch already resolved
+    std::vector<glm::vec3> specularColors;
+    std::vector<float> shininesses;
+
+    size_t numPixels() const { return static_cast<size_t>(resolution.x) * static_cast<size_t>(resolution.y); }
+    size_t pixelIndex(int x, int y) const { return (static_cast<size_t>(y) * static_cast<size_t>(resolution.x)) + static_cast<size_t>(x); }
+
+    glm::vec3 normal(size_t pixelIdx) const { return octahedralNormals ? decodeOctahedral(encodedNormals[pixelIdx]) : normals[pixelIdx]; }
+    ShadingPoint shadingPoint(size_t pixelIdx) const;
+
+    // Resolve the shading point of the given primary hit into the given pixel
+    void store(size_t pixelIdx, const RayHit& primaryHit, const Scene& scene, const Features& features);
+};
+
+#endif // _G_BUFFER_H_
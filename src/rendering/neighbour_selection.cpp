@@ -1,7 +1,6 @@
 #include "neighbour_selection.h"
 
 #include <algorithm>
-#include <random>
 
 
 bool areSimilar(const RayHit& lhs, const RayHit& rhs, const Features& features) {
@@ -21,28 +20,25 @@ bool areSimilar(const RayHit& lhs, const RayHit& rhs, const Features& features)
     return true;
 }
 
-std::vector<glm::ivec2> indicesRandom(int32_t x, int32_t y,
-                                         const glm::ivec2& windowResolution, const Features& features) {
+std::vector<glm::ivec2> indicesRandom(int32_t x, int32_t y, Sampler& sampler,
+                                      const glm::ivec2& windowResolution, const Features& features) {
     // Define the range of possible values based on window dimensions and resample radius
-    std::random_device rd;
-    std::mt19937 gen(rd());
     int32_t resampleRadiusCast = static_cast<int32_t>(features.spatialResampleRadius);
-    std::uniform_int_distribution<> distrX(std::max(0, x - resampleRadiusCast),
-                                           std::min(windowResolution.x - 1, x + resampleRadiusCast));
-    std::uniform_int_distribution<> distrY(std::max(0, y - resampleRadiusCast),
-                                           std::min(windowResolution.y - 1, y + resampleRadiusCast));
+    glm::ivec2 minExtents(std::max(0, x - resampleRadiusCast),                      std::max(0, y - resampleRadiusCast));
+    glm::ivec2 maxExtents(std::min(windowResolution.x - 1, x + resampleRadiusCast), std::min(windowResolution.y - 1, y + resampleRadiusCast));
 
     // Create indices
     std::vector<glm::ivec2> indices;
     indices.reserve(features.numNeighboursToSample + 1);    // Assign enough space for current pixel AND neighbours
     indices.push_back(glm::ivec2(x, y));                    // Always include the pixel itself
     for (uint32_t candidateIdx = 0U; candidateIdx < features.numNeighboursToSample; candidateIdx++) {
-        indices.push_back(glm::ivec2(distrX(gen), distrY(gen)));
+        sampler.startSample(candidateIdx);
+        indices.push_back(glm::ivec2(sampler.nextInt(minExtents.x, maxExtents.x), sampler.nextInt(minExtents.y, maxExtents.y)));
     }
     return indices;
 }
 
-std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y,
+std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y, Sampler& sampler,
                                           const PrimaryHitGrid& primaryHits, const glm::ivec2& windowResolution, const Features& features) {
     // In extreme cases, all neighbours are similar or dissimilar. We reserve enough memory for either
     std::vector<glm::ivec2> similarIndices, dissimilarIndices;
@@ -73,22 +69,20 @@ std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y,
     std::vector<glm::ivec2> indices;
     indices.reserve(features.numNeighboursToSample + 1);    // Assign enough space for current pixel AND neighbours
     indices.push_back(glm::ivec2(x, y));                    // Always include the pixel itself
-    std::random_device rd;
-    std::mt19937 rng(rd());
     switch (features.neighbourSelectionStrategy) {
         case NeighbourSelectionStrategy::Similar: {
             if (similarIndices.size() < features.numNeighboursToSample) {                                       // Not enough similar neighbours
                 indices.insert(indices.end(), similarIndices.begin(), similarIndices.end());                    // Place however many we can
                 std::sample(dissimilarIndices.begin(), dissimilarIndices.end(), std::back_inserter(indices),    // Make up for deficit from dissimilar neighbours
-                            features.numNeighboursToSample - similarIndices.size(), rng); 
-            } else { std::sample(similarIndices.begin(), similarIndices.end(), std::back_inserter(indices), features.numNeighboursToSample, rng); }
+                            features.numNeighboursToSample - similarIndices.size(), sampler); 
+            } else { std::sample(similarIndices.begin(), similarIndices.end(), std::back_inserter(indices), features.numNeighboursToSample, sampler); }
         } break;
         case NeighbourSelectionStrategy::Dissimilar: {
             if (dissimilarIndices.size() < features.numNeighboursToSample) {                            // Not enough dissimilar neighbours
                 indices.insert(indices.end(), dissimilarIndices.begin(), dissimilarIndices.end());      // Place however many we can
                 std::sample(similarIndices.begin(), similarIndices.end(), std::back_inserter(indices),  // Make up for deficit from similar neighbours
-                            features.numNeighboursToSample - similarIndices.size(), rng);
-            } else { std::sample(dissimilarIndices.begin(), dissimilarIndices.end(), std::back_inserter(indices), features.numNeighboursToSample, rng); }
+                            features.numNeighboursToSample - similarIndices.size(), sampler);
+            } else { std::sample(dissimilarIndices.begin(), dissimilarIndices.end(), std::back_inserter(indices), features.numNeighboursToSample, sampler); }
         } break;
         case NeighbourSelectionStrategy::EqualSimilarDissimilar: {
             // Ensure there are sufficient quantities of similars and dissimilars to satisfy halfway split and make up for difference if that is not possible
@@ -96,8 +90,8 @@ std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y,
             uint32_t desiredDissimilars = features.numNeighboursToSample - similarsSampled;
             if (desiredDissimilars > dissimilarIndices.size()) { similarsSampled += features.numNeighboursToSample - dissimilarIndices.size() - similarsSampled; }
 
-            std::sample(similarIndices.begin(),     similarIndices.end(),       std::back_inserter(indices), similarsSampled, rng);
-            std::sample(dissimilarIndices.begin(),  dissimilarIndices.end(),    std::back_inserter(indices), features.numNeighboursToSample - similarsSampled, rng);
+            std::sample(similarIndices.begin(),     similarIndices.end(),       std::back_inserter(indices), similarsSampled, sampler);
+            std::sample(dissimilarIndices.begin(),  dissimilarIndices.end(),    std::back_inserter(indices), features.numNeighboursToSample - similarsSampled, sampler);
         } break;
         default: { throw std::runtime_error("indicesSimilarity called with unsupported neighbour selection strategy"); }
     }
@@ -105,7 +99,7 @@ std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y,
 }
 
 ResampleIndicesGrid generateResampleIndicesGrid(const PrimaryHitGrid& primaryHits,
-                                                const glm::ivec2& windowResolution, const Features& features) {
+                                                const glm::ivec2& windowResolution, const Features& features, uint32_t frameIdx) {
     ResampleIndicesGrid resampleIndices(windowResolution.y, std::vector<std::vector<glm::ivec2>>(windowResolution.x));
     bool useRandom = features.neighbourSelectionStrategy == NeighbourSelectionStrategy::Random;
     #ifdef NDEBUG
@@ -113,9 +107,10 @@ ResampleIndicesGrid generateResampleIndicesGrid(const PrimaryHitGrid& primaryHit
     #endif
     for (int y = 0; y < windowResolution.y; y++) {
         for (int x = 0; x != windowResolution.x; x++) {
-            resampleIndices[y][x] = useRandom                                       ?
-                                    indicesRandom(x, y, windowResolution, features) :
-                                    indicesSimilarity(x, y, primaryHits, windowResolution, features);
+            Sampler sampler(glm::ivec2(x, y), frameIdx, SampleStream::NeighbourSelection, 0U, features.sampleSequence);
+            resampleIndices[y][x] = useRandom                                                ?
+                                    indicesRandom(x, y, sampler, windowResolution, features) :
+                                    indicesSimilarity(x, y, sampler, primaryHits, windowResolution, features);
         }
     }
     return resampleIndices;
@@ -9,6 +9,7 @@ DISABLE_WARNINGS_POP()
 
 #include <rendering/render_utils.h>
 #include <utils/common.h>
+#include <utils/sampler.h>
 
 #include <vector>
 
@@ -16,11 +17,11 @@ DISABLE_WARNINGS_POP()
 using ResampleIndicesGrid = std::vector<std::vector<std::vector<glm::ivec2>>>;
 
 bool areSimilar(const RayHit& lhs, const RayHit& rhs, const Features& features);
-std::vector<glm::ivec2> indicesRandom(int32_t x, int32_t y,
+std::vector<glm::ivec2> indicesRandom(int32_t x, int32_t y, Sampler& sampler,
                                       const glm::ivec2& windowResolution, const Features& features);
-std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y,
+std::vector<glm::ivec2> indicesSimilarity(int32_t x, int32_t y, Sampler& sampler,
                                           const PrimaryHitGrid& primaryHits, const glm::ivec2& windowResolution, const Features& features);
 ResampleIndicesGrid generateResampleIndicesGrid(const PrimaryHitGrid& primaryHits,
-                                                const glm::ivec2& windowResolution, const Features& features);
+                                                const glm::ivec2& windowResolution, const Features& features, uint32_t frameIdx);
 
 #endif // _NEIGHBOUR_SELECTION_H_
@@ -15,7 +15,9 @@ DISABLE_WARNINGS_POP()
 #include <rendering/neighbour_selection.h>
 #include <rendering/render_utils.h>
 #include <rendering/screen.h>
+#include <ray_tracing/shadow_ray_queue.h>
 #include <scene/light.h>
+#include <scene/light_sampler.h>
 #include <utils/magic_enum.hpp>
 #include <utils/progressbar.hpp>
 #include <utils/utils.h>
@@ -23,17 +25,31 @@ DISABLE_WARNINGS_POP()
 #include <array>
 #include <fstream>
 #include <iostream>
+#include <utility>
 
 
-ReservoirGrid renderReSTIR(std::shared_ptr<ReservoirGrid> previousFrameGrid,
-                           const Scene& scene, const Trackball& camera,
-                           const EmbreeInterface& embreeInterface, Screen& screen,
-                           const Features& features) {
+template <size_t Capacity>
+ReservoirGrid<Capacity> renderReSTIR(std::shared_ptr<AnyReservoirGrid> previousFrameGrid, AnyReservoirGrid& spatialSwapGrid,
+                                     const Scene& scene, const Trackball& camera,
+                                     const EmbreeInterface& embreeInterface, Screen& screen,
+                                     const Features& features, uint32_t frameIdx) {
     std::cout << "===== Rendering with ReSTIR =====" << std::endl;
-    PrimaryHitGrid primaryHits  = genPrimaryRayHits(scene, camera, embreeInterface, screen, features);
-    ReservoirGrid reservoirGrid = genInitialSamples(primaryHits, scene, embreeInterface, features, screen.resolution());
-    if (features.temporalReuse && previousFrameGrid)    { temporalReuse(reservoirGrid, *previousFrameGrid.get(), embreeInterface, screen, features); }
-    if (features.spatialReuse)                          { spatialReuse(reservoirGrid, embreeInterface, screen, features); }
+    const LightSampler lightSampler(scene, features);
+    const GBuffer gBuffer                   = genGBuffer(genPrimaryRayHits(scene, camera, embreeInterface, screen, features), scene, features, screen.resolution());
+    ReservoirGrid<Capacity> reservoirGrid   = genInitialSamples<Capacity>(gBuffer, scene, lightSampler, embreeInterface, features, screen.resolution(), frameIdx);
+
+    // History rendered at a different resolution, with a different reservoir capacity or (in compact form) with more samples than fit the
+    // current capacity cannot be combined with the current frame and is dropped
+    if (features.temporalReuse && previousFrameGrid) {
+        ReservoirGrid<Capacity>* previousGrid       = std::get_if<ReservoirGrid<Capacity>>(previousFrameGrid.get());
+        CompactReservoirGrid* compactPreviousGrid   = std::get_if<CompactReservoirGrid>(previousFrameGrid.get());
+        if (previousGrid && previousGrid->resolution == reservoirGrid.resolution) {
+            temporalReuse(reservoirGrid, *previousGrid, gBuffer, scene, screen, features, frameIdx);
+        } else if (compactPreviousGrid && compactPreviousGrid->resolution == reservoirGrid.resolution && compactPreviousGrid->numSamples <= Capacity) {
+            temporalReuse(reservoirGrid, *compactPreviousGrid, gBuffer, scene, screen, features, frameIdx);
+        }
+    }
+    if (features.spatialReuse)                          { spatialReuse(reservoirGrid, spatialSwapGrid, gBuffer, embreeInterface, screen, features, frameIdx); }
 
     // Final shading
     glm::ivec2 windowResolution = screen.resolution();
@@ -43,10 +59,20 @@ ReservoirGrid renderReSTIR(std::shared_ptr<ReservoirGrid> previousFrameGrid,
     #pragma omp parallel for schedule(guided)
     #endif
     for (int y = 0; y < windowResolution.y; y++) {
+        // Trace visibility of all final samples in the row at once
+        ShadowRayQueue shadowRayQueue(embreeInterface, features.sortShadowRays);
+        for (int x = 0; x != windowResolution.x; x++) {
+            const ConstReservoirView<Capacity> reservoir = std::as_const(reservoirGrid).view(x, y);
+            for (const glm::vec3& position : reservoir.positions) { shadowRayQueue.enqueue(position, gBuffer.positions[reservoir.pixelIdx]); }
+        }
+        shadowRayQueue.flush();
+
+        size_t slot = 0ULL;
         for (int x = 0; x != windowResolution.x; x++) {
             // Compute shading from final sample(s)
-            const Reservoir& reservoir  = reservoirGrid[y][x];
-            glm::vec3 finalColor        = finalShading(reservoir, reservoir.cameraRay, embreeInterface, features);
+            const ConstReservoirView<Capacity> reservoir    = std::as_const(reservoirGrid).view(x, y);
+            glm::vec3 finalColor                            = finalShading(reservoir, shadowRayQueue, slot, gBuffer);
+            slot                                            += reservoir.size();
 
             // Apply tone mapping and set final pixel color
             if (features.enableToneMapping) { finalColor = exposureToneMapping(finalColor, features); }
@@ -61,49 +87,68 @@ ReservoirGrid renderReSTIR(std::shared_ptr<ReservoirGrid> previousFrameGrid,
     return reservoirGrid;
 }
 
-void renderRMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features) {
+template <size_t Capacity>
+void renderRMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features, uint32_t frameIdx) {
     std::cout << "===== Rendering with R-MIS =====" << std::endl;
     glm::ivec2 windowResolution         = screen.resolution();
     const uint32_t totalDistributions   = features.numNeighboursToSample + 1U; // Original pixel and neighbours
+    const LightSampler lightSampler(scene, features);
     PrimaryHitGrid primaryHits          = genPrimaryRayHits(scene, camera, embreeInterface, screen, features);
-    ResampleIndicesGrid resampleIndices = generateResampleIndicesGrid(primaryHits, windowResolution, features);
+    const GBuffer gBuffer               = genGBuffer(primaryHits, scene, features, windowResolution);
+    ResampleIndicesGrid resampleIndices = generateResampleIndicesGrid(primaryHits, windowResolution, features, frameIdx);
     PixelGrid finalPixelColors(windowResolution.y,   std::vector<glm::vec3>(windowResolution.x, glm::vec3(0.0f)));
 
     for (uint32_t iteration = 0U; iteration < features.maxIterationsMIS; iteration++) {
         std::cout << "= Iteration " << iteration + 1 << std::endl;
-        ReservoirGrid reservoirGrid = genInitialSamples(primaryHits, scene, embreeInterface, features, windowResolution);
+        const ReservoirGrid<Capacity> reservoirGrid = genInitialSamples<Capacity>(gBuffer, scene, lightSampler, embreeInterface, features, windowResolution, frameIdx, iteration);
         progressbar progressBarPixels(windowResolution.y);
         #ifdef NDEBUG
         #pragma omp parallel for schedule(guided)
         #endif
         for (int y = 0; y < windowResolution.y; y++) {
+            // Trace visibility of all neighbourhood samples at every pixel of the row at once
+            ShadowRayQueue shadowRayQueue(embreeInterface, features.sortShadowRays);
+            for (int x = 0; x != windowResolution.x; x++) {
+                for (const glm::ivec2& index : resampleIndices[y][x]) {
+                    for (const glm::vec3& position : reservoirGrid.view(index.x, index.y).positions) { shadowRayQueue.enqueue(position, gBuffer.positions[gBuffer.pixelIndex(x, y)]); }
+                }
+            }
+            shadowRayQueue.flush();
+
+            size_t slot = 0ULL;
             for (int x = 0; x != windowResolution.x; x++) {
-                // Collect primary ray info
-                const Ray& primaryRay           = reservoirGrid[y][x].cameraRay;
-                const HitInfo& primaryHitInfo   = reservoirGrid[y][x].hitInfo;
+                // Collect primary hit shading point
+                const ShadingPoint primaryShadingPoint = gBuffer.shadingPoint(gBuffer.pixelIndex(x, y));
 
                 // Gather samples from neighborhood defined by resample radius
-                std::vector<Reservoir> neighborhood;
+                std::vector<Reservoir<Capacity>> neighborhood;
                 neighborhood.reserve(totalDistributions); // Include space for the current pixel AND neighbours
-                for (const glm::ivec2& index : resampleIndices[y][x]) { neighborhood.push_back(reservoirGrid[index.y][index.x]); }
+                for (const glm::ivec2& index : resampleIndices[y][x]) { neighborhood.push_back(reservoirGrid.view(index.x, index.y).load()); }
+
+                // Target function values needed by the balance heuristic, evaluated in batches
+                const TargetPDFMatrix neighbourhoodTargets  = features.misWeightRMIS == MISWeightRMIS::Balance  ?
+                                                              neighbourhoodTargetPDFs(neighborhood, gBuffer) :
+                                                              TargetPDFMatrix {};
 
                 // Combine shading results from all gathered pixels
                 glm::vec3 finalColor(0.0f);
-                for (const Reservoir& pixel : neighborhood) {
-                    for (const SampleData& sample : pixel.outputSamples) {
+                size_t neighbourhoodSampleIdx = 0ULL;
+                for (const Reservoir<Capacity>& pixel : neighborhood) {
+                    for (const SampleData& sample : pixel.samples()) {
                         // Compute MIS weight
                         float misWeight;
                         switch (features.misWeightRMIS) {
                             case MISWeightRMIS::Equal:      { misWeight = 1.0f / neighborhood.size(); } break;
-                            case MISWeightRMIS::Balance:    { misWeight = generalisedBalanceHeuristic(sample.lightSample, neighborhood, primaryRay, primaryHitInfo, features); } break;
+                            case MISWeightRMIS::Balance:    { misWeight = generalisedBalanceHeuristic(neighbourhoodTargets, neighbourhoodSampleIdx); } break;
                             default:                        { throw std::runtime_error(std::format("Unhandled MIS weight type: {}", magic_enum::enum_name<MISWeightRMIS>(features.misWeightRMIS))); }
                         }
 
                         // Evaluate sample contribution
-                        glm::vec3 sampleColor   = testVisibilityLightSample(sample.lightSample.position, embreeInterface, features, primaryRay, primaryHitInfo)             ?
-                                                  computeShading(sample.lightSample.position, sample.lightSample.color, features, primaryRay, primaryHitInfo)   :
+                        glm::vec3 sampleColor   = shadowRayQueue.visible(slot++)                                                                 ?
+                                                  computeShading(sample.lightSample.position, sample.lightSample.color, primaryShadingPoint)   :
                                                   glm::vec3(0.0f);
-                        finalColor              += (misWeight * sampleColor * sample.outputWeight) / glm::vec3(static_cast<float>(pixel.outputSamples.size()));
+                        finalColor              += (misWeight * sampleColor * sample.outputWeight) / glm::vec3(static_cast<float>(pixel.size()));
+                        neighbourhoodSampleIdx++;
                     }
                 }
 
@@ -118,12 +163,15 @@ void renderRMIS(const Scene& scene, const Trackball& camera, const EmbreeInterfa
     combineToScreen(screen, finalPixelColors, features);
 }
 
-void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features) {
+template <size_t Capacity>
+void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features, uint32_t frameIdx) {
     // Used in both direct and progressive estimators
     std::cout << "===== Rendering with R-OMIS ====="   << std::endl;
     glm::ivec2 windowResolution             = screen.resolution();
+    const LightSampler lightSampler(scene, features);
     PrimaryHitGrid primaryHits              = genPrimaryRayHits(scene, camera, embreeInterface, screen, features);
-    ResampleIndicesGrid resampleIndices     = generateResampleIndicesGrid(primaryHits, windowResolution, features);
+    const GBuffer gBuffer                   = genGBuffer(primaryHits, scene, features, windowResolution);
+    ResampleIndicesGrid resampleIndices     = generateResampleIndicesGrid(primaryHits, windowResolution, features, frameIdx);
     const uint32_t totalDistributions       = features.numNeighboursToSample + 1U; // Original pixel and neighbours
     MatrixGrid techniqueMatrices(windowResolution.y,        std::vector<Eigen::MatrixXf>(windowResolution.x, Eigen::MatrixXf::Zero(totalDistributions, totalDistributions)));
     VectorGrid contributionVectorsRed(windowResolution.y,   std::vector<Eigen::VectorXf>(windowResolution.x, Eigen::VectorXf::Zero(totalDistributions)));
@@ -140,21 +188,30 @@ void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterf
 
     for (uint32_t iteration = 0U; iteration < features.maxIterationsMIS; iteration++) {
         std::cout << "= Iteration " << iteration + 1 << std::endl;
-        ReservoirGrid reservoirGrid = genInitialSamples(primaryHits, scene, embreeInterface, features, windowResolution);
+        const ReservoirGrid<Capacity> reservoirGrid = genInitialSamples<Capacity>(gBuffer, scene, lightSampler, embreeInterface, features, windowResolution, frameIdx, iteration);
         progressbar progressbarPixels(static_cast<int32_t>(windowResolution.y));
         #ifdef NDEBUG
         #pragma omp parallel for schedule(guided)
         #endif
         for (int y = 0; y < windowResolution.y; y++) {
+            // Trace visibility of all neighbourhood samples at every pixel of the row at once
+            ShadowRayQueue shadowRayQueue(embreeInterface, features.sortShadowRays);
+            for (int x = 0; x != windowResolution.x; x++) {
+                for (const glm::ivec2& index : resampleIndices[y][x]) {
+                    for (const glm::vec3& position : reservoirGrid.view(index.x, index.y).positions) { shadowRayQueue.enqueue(position, gBuffer.positions[gBuffer.pixelIndex(x, y)]); }
+                }
+            }
+            shadowRayQueue.flush();
+
+            size_t slot = 0ULL;
             for (int x = 0; x != windowResolution.x; x++) {
-                // Collect primary ray info
-                const Ray& primaryRay           = reservoirGrid[y][x].cameraRay;
-                const HitInfo& primaryHitInfo   = reservoirGrid[y][x].hitInfo;
+                // Collect primary hit shading point
+                const ShadingPoint primaryShadingPoint = gBuffer.shadingPoint(gBuffer.pixelIndex(x, y));
 
                 // Gather samples from neighborhood defined by resample radius
-                std::vector<Reservoir> neighborhood;
+                std::vector<Reservoir<Capacity>> neighborhood;
                 neighborhood.reserve(totalDistributions);
-                for (const glm::ivec2& index : resampleIndices[y][x]) { neighborhood.push_back(reservoirGrid[index.y][index.x]); }
+                for (const glm::ivec2& index : resampleIndices[y][x]) { neighborhood.push_back(reservoirGrid.view(index.x, index.y).load()); }
 
                 // ===== PROGRESSIVE ONLY =====
                 // Update alpha vector estimates
@@ -164,7 +221,11 @@ void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterf
                     alphaVectorsBlue[y][x]  = solveSystem(techniqueMatrices[y][x], contributionVectorsBlue[y][x]);
                 }
                 
+                // Target function values of all neighbourhood samples under every technique, evaluated in batches
+                const TargetPDFMatrix neighbourhoodTargets = neighbourhoodTargetPDFs(neighborhood, gBuffer);
+
                 // Construct elements of the technique matrix and contribution vector estimates
+                size_t neighbourhoodSampleIdx = 0ULL;
                 for (size_t pixelIdx = 0ULL; pixelIdx < totalDistributions; pixelIdx++) {
                     // ===== PROGRESSIVE ONLY ===
                     // Add this pixel's portion of the sum of alpha to current iteration estimate
@@ -172,20 +233,21 @@ void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterf
                                                         alphaVectorsGreen[y][x](pixelIdx),
                                                         alphaVectorsBlue[y][x](pixelIdx));
 
-                    const Reservoir& pixel = neighborhood[pixelIdx];
-                    for (size_t sampleIdx = 0ULL; sampleIdx < pixel.outputSamples.size(); sampleIdx++) {
+                    const Reservoir<Capacity>& pixel = neighborhood[pixelIdx];
+                    for (size_t sampleIdx = 0ULL; sampleIdx < pixel.size(); sampleIdx++, neighbourhoodSampleIdx++) {
                         const SampleData& sample = pixel.outputSamples[sampleIdx];
 
                         // Compute column vector of all sampling techniques evaluated with current sample
                         Eigen::VectorXf colVecW(totalDistributions);
                         for (int32_t distributionIdx = 0ULL; distributionIdx < totalDistributions; distributionIdx++) {
-                            const Reservoir& distribution   = neighborhood[distributionIdx];
-                            colVecW(distributionIdx)        = arbitraryUnbiasedContributionWeightReciprocal(sample.lightSample, distribution, scene, sampleIdx, features);
+                            const Reservoir<Capacity>& distribution = neighborhood[distributionIdx];
+                            colVecW(distributionIdx)                = arbitraryUnbiasedContributionWeightReciprocal(sample.lightSample, neighbourhoodTargets[distributionIdx][neighbourhoodSampleIdx],
+                                                                                                            distribution, gBuffer, lightSampler, sampleIdx);
                         }
 
                         // Evaluate shading (integrand function) for the current sample
-                        glm::vec3 sampleColor = testVisibilityLightSample(sample.lightSample.position, embreeInterface, features, primaryRay, primaryHitInfo)           ?
-                                                computeShading(sample.lightSample.position, sample.lightSample.color, features, primaryRay, primaryHitInfo) :
+                        glm::vec3 sampleColor = shadowRayQueue.visible(slot++)                                                               ?
+                                                computeShading(sample.lightSample.position, sample.lightSample.color, primaryShadingPoint) :
                                                 glm::vec3(0.0f);
 
                         // ===== PROGRESSIVE ONLY =====
@@ -265,18 +327,25 @@ void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterf
 }
 
 
-std::optional<ReservoirGrid> renderRayTraced(std::shared_ptr<ReservoirGrid> previousFrameGrid,
-                                             const Scene& scene, const Trackball& camera,
-                                             const EmbreeInterface& embreeInterface, Screen& screen,
-                                             const Features& features) {
-    // Render with desired mode
-    std::optional<ReservoirGrid> finalReservoirs = std::nullopt;
-    switch (features.rayTraceMode) {
-        case RayTraceMode::ReSTIR:  { finalReservoirs = renderReSTIR(previousFrameGrid, scene, camera, embreeInterface, screen, features); } break;
-        case RayTraceMode::RMIS:    { renderRMIS(scene, camera, embreeInterface, screen, features); } break;
-        case RayTraceMode::ROMIS:   { renderROMIS(scene, camera, embreeInterface, screen, features); } break;
-        default:                    { throw std::runtime_error("Unsupported ray-tracing render mode requested from entry point"); }
-    }
+std::optional<AnyReservoirGrid> renderRayTraced(std::shared_ptr<AnyReservoirGrid> previousFrameGrid, AnyReservoirGrid& spatialSwapGrid,
+                                                const Scene& scene, const Trackball& camera,
+                                                const EmbreeInterface& embreeInterface, Screen& screen,
+                                                const Features& features, uint32_t frameIdx) {
+    // Render with desired mode, with reservoirs of the capacity fitting the requested number of samples
+    std::optional<AnyReservoirGrid> finalReservoirs = std::nullopt;
+    dispatchReservoirCapacity(features.numSamplesInReservoir, [&](auto capacity) {
+        constexpr size_t Capacity = decltype(capacity)::value;
+        switch (features.rayTraceMode) {
+            case RayTraceMode::ReSTIR:  {
+                ReservoirGrid<Capacity> finalGrid = renderReSTIR<Capacity>(previousFrameGrid, spatialSwapGrid, scene, camera, embreeInterface, screen, features, frameIdx);
+                if (features.compactReservoirs) { finalReservoirs = finalGrid.compact(scene); }
+                else                            { finalReservoirs = std::move(finalGrid); }
+            } break;
+            case RayTraceMode::RMIS:    { renderRMIS<Capacity>(scene, camera, embreeInterface, screen, features, frameIdx); } break;
+            case RayTraceMode::ROMIS:   { renderROMIS<Capacity>(scene, camera, embreeInterface, screen, features, frameIdx); } break;
+            default:                    { throw std::runtime_error("Unsupported ray-tracing render mode requested from entry point"); }
+        }
+    });
 
     // Save used configuration to timestamped file
     std::filesystem::path renderDirPath = RENDERS_DIR;
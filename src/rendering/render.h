@@ -8,8 +8,9 @@ DISABLE_WARNINGS_POP()
 
 #include <framework/ray.h>
 
-#include <rendering/reservoir.h>
+#include <rendering/reservoir_grid.h>
 
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -22,15 +23,19 @@ struct Features;
 
 
 // All rendering modes on offer
-ReservoirGrid renderReSTIR(std::shared_ptr<ReservoirGrid> previousFrameGrid,
-                           const Scene& scene, const Trackball& camera,
-                           const EmbreeInterface& embreeInterface, Screen& screen,
-                           const Features& features);
-void renderRMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features);
-void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features);
+// Reservoirs have the capacity picked from Features::numSamplesInReservoir by the entry point (see dispatchReservoirCapacity)
+template <size_t Capacity>
+ReservoirGrid<Capacity> renderReSTIR(std::shared_ptr<AnyReservoirGrid> previousFrameGrid, AnyReservoirGrid& spatialSwapGrid,
+                                     const Scene& scene, const Trackball& camera,
+                                     const EmbreeInterface& embreeInterface, Screen& screen,
+                                     const Features& features, uint32_t frameIdx);
+template <size_t Capacity>
+void renderRMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features, uint32_t frameIdx);
+template <size_t Capacity>
+void renderROMIS(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, Screen& screen, const Features& features, uint32_t frameIdx);
 
-// Entry point to ray-tracing rendering modes
-std::optional<ReservoirGrid> renderRayTraced(std::shared_ptr<ReservoirGrid> previousFrameGrid,
-                                             const Scene& scene, const Trackball& camera,
-                                             const EmbreeInterface& embreeInterface, Screen& screen,
-                                             const Features& features);
+// Entry point to ray-tracing rendering modes. The spatial swap grid is scratch for ReSTIR's spatial reuse, kept alive across frames
+std::optional<AnyReservoirGrid> renderRayTraced(std::shared_ptr<AnyReservoirGrid> previousFrameGrid, AnyReservoirGrid& spatialSwapGrid,
+                                                const Scene& scene, const Trackball& camera,
+                                                const EmbreeInterface& embreeInterface, Screen& screen,
+                                                const Features& features, uint32_t frameIdx);
@@ -3,28 +3,47 @@
 #include <framework/trackball.h>
 
 #include <post_processing/tone_mapping.h>
+#include <ray_tracing/shadow_ray_queue.h>
 #include <scene/light.h>
 #include <utils/progressbar.hpp>
 #include <utils/utils.h>
 
 #include <algorithm>
-#include <random>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 PrimaryHitGrid genPrimaryRayHits(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, const Screen& screen, const Features& features) {
     glm::ivec2 windowResolution = screen.resolution();
     PrimaryHitGrid primaryHits(windowResolution.y, std::vector<RayHit>(windowResolution.x));
 
-    progressbar progressbar(windowResolution.y);
+    // Trace in screen tiles whose rows are exactly one packet wide, keeping the rays of each packet (and consecutive packets) coherent
+    const int32_t tileWidth     = static_cast<int32_t>(EmbreeInterface::PACKET_SIZE);
+    const int32_t numTileRows   = (windowResolution.y + PRIMARY_TILE_HEIGHT - 1) / PRIMARY_TILE_HEIGHT;
+    progressbar progressbar(numTileRows);
     std::cout << "Primary rays computation..." << std::endl;
     #ifdef NDEBUG
     #pragma omp parallel for schedule(guided)
     #endif
-    for (int y = 0; y < windowResolution.y; y++) {
-        for (int x = 0; x != windowResolution.x; x++) {
-            const glm::vec2 normalizedPixelPos { float(x) / float(windowResolution.x) * 2.0f - 1.0f,
-                                                 float(y) / float(windowResolution.y) * 2.0f - 1.0f };
-            primaryHits[y][x].ray = camera.generateRay(normalizedPixelPos); 
-            embreeInterface.closestHit(primaryHits[y][x].ray, primaryHits[y][x].hit);
+    for (int tileRow = 0; tileRow < numTileRows; tileRow++) {
+        const int tileMinY = tileRow * PRIMARY_TILE_HEIGHT;
+        const int tileMaxY = std::min(tileMinY + PRIMARY_TILE_HEIGHT, windowResolution.y);
+        for (int tileMinX = 0; tileMinX < windowResolution.x; tileMinX += tileWidth) {
+            const int tileMaxX = std::min(tileMinX + tileWidth, windowResolution.x);
+            for (int y = tileMinY; y < tileMaxY; y++) {
+                for (int x = tileMinX; x < tileMaxX; x++) {
+                    const glm::vec2 normalizedPixelPos { float(x) / float(windowResolution.x) * 2.0f - 1.0f,
+                                                         float(y) / float(windowResolution.y) * 2.0f - 1.0f };
+                    primaryHits[y][x].ray = camera.generateRay(normalizedPixelPos);
+                }
+                std::span<RayHit> packetRayHits = std::span<RayHit>(primaryHits[y]).subspan(tileMinX, tileMaxX - tileMinX);
+                embreeInterface.closestHitPacket(packetRayHits);
+                embreeInterface.resolveHitAttributes(packetRayHits); // Batched right after tracing, while the tile's hits are still in cache
+            }
         }
         #pragma omp critical
         progressbar.update();
@@ -33,16 +52,55 @@ PrimaryHitGrid genPrimaryRayHits(const Scene& scene, const Trackball& camera, co
     return primaryHits;
 }
 
-ReservoirGrid genInitialSamples(const PrimaryHitGrid& primaryHits, const Scene& scene, const EmbreeInterface& embreeInterface, const Features& features, const glm::ivec2& windowResolution) {
-    ReservoirGrid initialSamples(windowResolution.y, std::vector<Reservoir>(windowResolution.x, Reservoir(features.numSamplesInReservoir)));
+GBuffer genGBuffer(const PrimaryHitGrid& primaryHits, const Scene& scene, const Features& features, const glm::ivec2& windowResolution) {
+    GBuffer gBuffer(windowResolution, features);
+    #ifdef NDEBUG
+    #pragma omp parallel for
+    #endif
+    for (int y = 0; y < windowResolution.y; y++) {
+        for (int x = 0; x != windowResolution.x; x++) { gBuffer.store(gBuffer.pixelIndex(x, y), primaryHits[y][x], scene, features); }
+    }
+    return gBuffer;
+}
+
+template <size_t Capacity>
+ReservoirGrid<Capacity> genInitialSamples(const GBuffer& gBuffer, const Scene& scene, const LightSampler& lightSampler, const EmbreeInterface& embreeInterface,
+                                          const Features& features, const glm::ivec2& windowResolution,
+                                          uint32_t frameIdx, uint32_t pass) {
+    ReservoirGrid<Capacity> initialSamples(windowResolution, features.numSamplesInReservoir);
+
+    // Light tiles hold samples of a single distribution for all pixels, which a shading-point-dependent sampler does not have
+    std::optional<LightTiles> lightTiles;
+    if (features.presampledLightTiles && !lightSampler.shadingPointDependent()) { lightTiles.emplace(scene, lightSampler, features, frameIdx, pass); }
+
     progressbar progressbar(windowResolution.y);
     std::cout << "Initial light samples generation..." << std::endl;
     #ifdef NDEBUG
     #pragma omp parallel for schedule(guided)
     #endif
     for (int y = 0; y < windowResolution.y; y++) {
+        ResamplingScratch scratch;
         for (int x = 0; x != windowResolution.x; x++) {
-            initialSamples[y][x] = genCanonicalSamples(scene, embreeInterface, features, primaryHits[y][x]);
+            Sampler sampler(glm::ivec2(x, y), frameIdx, SampleStream::InitialSamples, pass, features.sampleSequence);
+            std::span<const PresampledLight> lightTile  = lightTiles ? lightTiles->tileForPixel(glm::ivec2(x, y)) : std::span<const PresampledLight>();
+            initialSamples.view(x, y).store(genCanonicalSamples<Capacity>(scene, lightSampler, lightTile, features, gBuffer, gBuffer.pixelIndex(x, y), sampler, scratch));
+        }
+
+        // Optional visibility check, traced for the entire row at once
+        if (features.initialSamplesVisibilityCheck) {
+            ShadowRayQueue shadowRayQueue(embreeInterface, features.sortShadowRays);
+            for (int x = 0; x != windowResolution.x; x++) {
+                const ConstReservoirView<Capacity> reservoir = std::as_const(initialSamples).view(x, y);
+                for (const glm::vec3& position : reservoir.positions) { shadowRayQueue.enqueue(position, gBuffer.positions[reservoir.pixelIdx]); }
+            }
+            shadowRayQueue.flush();
+
+            // Slots are in the grid's order, so the row's weights are a single dense range
+            const std::span<float> rowWeights = std::span(initialSamples.outputWeights).subspan(initialSamples.pixelIndex(0, y) * initialSamples.numSamples,
+                                                                                                windowResolution.x * initialSamples.numSamples);
+            for (size_t slot = 0ULL; slot < rowWeights.size(); slot++) {
+                if (!shadowRayQueue.visible(slot)) { rowWeights[slot] = 0.0f; }
+            }
         }
         #pragma omp critical
         progressbar.update();
@@ -51,16 +109,18 @@ ReservoirGrid genInitialSamples(const PrimaryHitGrid& primaryHits, const Scene&
     return initialSamples;
 }
 
-glm::vec3 finalShading(const Reservoir& reservoir, const Ray& primaryRay, const EmbreeInterface& embreeInterface, const Features& features) {
+template <size_t Capacity>
+glm::vec3 finalShading(const ConstReservoirView<Capacity>& reservoir, const ShadowRayQueue& shadowRayQueue, size_t firstSlot, const GBuffer& gBuffer) {
+    const ShadingPoint shadingPoint = gBuffer.shadingPoint(reservoir.pixelIdx);
     glm::vec3 finalColor(0.0f);
-    for (const SampleData& sample : reservoir.outputSamples) {
-        glm::vec3 sampleColor   = testVisibilityLightSample(sample.lightSample.position, embreeInterface, features, primaryRay, reservoir.hitInfo)              ?
-                                  computeShading(sample.lightSample.position, sample.lightSample.color, features, primaryRay, reservoir.hitInfo)    :
+    for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.size(); sampleIdx++) {
+        glm::vec3 sampleColor   = shadowRayQueue.visible(firstSlot + sampleIdx)                                        ?
+                                  computeShading(reservoir.positions[sampleIdx], reservoir.colors[sampleIdx], shadingPoint) :
                                   glm::vec3(0.0f);
-        sampleColor             *= sample.outputWeight;
+        sampleColor             *= reservoir.outputWeights[sampleIdx];
         finalColor              += sampleColor;
     }
-    finalColor /= reservoir.outputSamples.size(); // Divide final shading value by number of samples
+    finalColor /= reservoir.size(); // Divide final shading value by number of samples
     return finalColor;
 }
 
@@ -84,15 +144,31 @@ void combineToScreen(Screen& screen, const PixelGrid& finalPixelColors, const Fe
     std::cout << std::endl;
 }
 
-void spatialReuse(ReservoirGrid& reservoirGrid, const EmbreeInterface& embreeInterface, const Screen& screen, const Features& features) {
+// The swap grid as a grid of the same shape as the frame's grid. Only reallocated when that shape changes, at which point it
+// takes the frame's pixel indices, which passes leave untouched
+template <size_t Capacity>
+static ReservoirGrid<Capacity>& matchingSwapGrid(AnyReservoirGrid& swapGrid, const ReservoirGrid<Capacity>& reservoirGrid) {
+    ReservoirGrid<Capacity>* grid = std::get_if<ReservoirGrid<Capacity>>(&swapGrid);
+    if (!grid || grid->resolution != reservoirGrid.resolution || grid->numSamples != reservoirGrid.numSamples) {
+        grid            = &swapGrid.emplace<ReservoirGrid<Capacity>>(reservoirGrid.resolution, reservoirGrid.numSamples);
+        grid->pixelIdxs = reservoirGrid.pixelIdxs;
+    }
+    return *grid;
+}
+
+template <size_t Capacity>
+void spatialReuse(ReservoirGrid<Capacity>& reservoirGrid, AnyReservoirGrid& swapGrid, const GBuffer& gBuffer, const EmbreeInterface& embreeInterface,
+                  const Screen& screen, const Features& features, uint32_t frameIdx) {
     // Uniform selection of neighbours in N pixel Manhattan distance radius
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distr(-static_cast<int32_t>(features.spatialResampleRadius), features.spatialResampleRadius);
+    const int32_t resampleRadius = static_cast<int32_t>(features.spatialResampleRadius);
 
     std::cout << "Spatial reuse..." << std::endl;
     glm::ivec2 windowResolution = screen.resolution();
-    ReservoirGrid prevIteration = reservoirGrid;
+
+    // Passes read from one grid and write the samples of every pixel to the other, and the two are swapped after every pass
+    ReservoirGrid<Capacity>& otherGrid  = matchingSwapGrid(swapGrid, reservoirGrid);
+    ReservoirGrid<Capacity>* readGrid   = &reservoirGrid;
+    ReservoirGrid<Capacity>* writeGrid  = &otherGrid;
     for (uint32_t pass = 0U; pass < features.spatialResamplingPasses; pass++) {
         std::cout << "Pass " << pass + 1 << std::endl;
         progressbar progressBarPixels(windowResolution.y);
@@ -100,48 +176,140 @@ void spatialReuse(ReservoirGrid& reservoirGrid, const EmbreeInterface& embreeInt
         #pragma omp parallel for schedule(guided)
         #endif
         for (int y = 0; y < windowResolution.y; y++) {
+            // Unbiased combinations of the whole row are finished together, once all of their visibility checks have been traced
+            ShadowRayQueue shadowRayQueue(embreeInterface, features.sortShadowRays);
+            ResamplingScratch scratch;
+            std::vector<std::vector<ConstReservoirView<Capacity>>> rowSelected;
+            std::vector<Reservoir<Capacity>> rowCombined;
+            std::vector<size_t> rowFirstSlots;
+            if (features.unbiasedCombination) {
+                rowSelected.reserve(static_cast<size_t>(windowResolution.x));
+                rowCombined.reserve(static_cast<size_t>(windowResolution.x));
+                rowFirstSlots.reserve(static_cast<size_t>(windowResolution.x));
+            }
             for (int x = 0; x != windowResolution.x; x++) {
                 // Select candidates
-                std::vector<Reservoir> selected;
+                std::vector<ConstReservoirView<Capacity>> selected;
                 selected.reserve(features.numNeighboursToSample + 1U); // Reserve memory needed for maximum possible number of samples (neighbours + current)
-                Reservoir& current = reservoirGrid[y][x];
+                const ConstReservoirView<Capacity> current = std::as_const(*readGrid).view(x, y);
+                Sampler sampler(glm::ivec2(x, y), frameIdx, SampleStream::SpatialReuse, pass, features.sampleSequence);
                 for (uint32_t neighbourCount = 0U; neighbourCount < features.numNeighboursToSample; neighbourCount++) {
-                    int neighbourX              = std::clamp(x + distr(gen), 0, windowResolution.x - 1);
-                    int neighbourY              = std::clamp(y + distr(gen), 0, windowResolution.y - 1);
-                    Reservoir neighbour         = prevIteration[neighbourY][neighbourX]; // Create copy for local modification
-                    
-                    // Conduct heuristic check if biased combination is used
+                    sampler.startSample(neighbourCount);
+                    int neighbourX  = std::clamp(x + sampler.nextInt(-resampleRadius, resampleRadius), 0, windowResolution.x - 1);
+                    int neighbourY  = std::clamp(y + sampler.nextInt(-resampleRadius, resampleRadius), 0, windowResolution.y - 1);
+
+                    // Conduct heuristic check if biased combination is used, on the G-buffer alone so rejected neighbours are never read
                     if (!features.unbiasedCombination) { 
-                        float depthFracDiff     = std::abs(1.0f - (neighbour.cameraRay.t / current.cameraRay.t));   // Check depth difference (greater than 10% leads to rejection) 
-                        float normalsDotProd    = glm::dot(neighbour.hitInfo.normal, current.hitInfo.normal);       // Check normal difference (greater than 25 degrees leads to rejection)
+                        const size_t neighbourPixelIdx  = gBuffer.pixelIndex(neighbourX, neighbourY);
+                        float depthFracDiff             = std::abs(1.0f - (gBuffer.depths[neighbourPixelIdx] / gBuffer.depths[current.pixelIdx]));   // Check depth difference (greater than 10% leads to rejection) 
+                        float normalsDotProd            = glm::dot(gBuffer.normal(neighbourPixelIdx), gBuffer.normal(current.pixelIdx));             // Check normal difference (greater than 25 degrees leads to rejection)
                         if (depthFracDiff > 0.1f || normalsDotProd < 0.90630778703f) { continue; } 
                     }
-                    
-                    selected.push_back(neighbour);
+
+                    selected.push_back(std::as_const(*readGrid).view(neighbourX, neighbourY));
                 }
 
                 // Ensure pixel's own reservoir is also considered
                 selected.push_back(current);
 
-                // Combine to single reservoir (biased or unbiased depending on user selection)
-                Reservoir combined(current.outputSamples.size());
-                combined.cameraRay  = current.cameraRay;
-                combined.hitInfo    = current.hitInfo;
-                if (features.unbiasedCombination)   { Reservoir::combineUnbiased(selected, combined, embreeInterface, features); }
-                else                                { Reservoir::combineBiased(selected, combined, features); }
-                reservoirGrid[y][x] = combined;
+                // Combine to single reservoir (biased or unbiased depending on user selection), the only reservoir written per pixel
+                Reservoir<Capacity> combined(current.size());
+                combined.pixelIdx = current.pixelIdx;
+                if (features.unbiasedCombination) {
+                    rowFirstSlots.push_back(Reservoir<Capacity>::combineUnbiased(selected, combined, shadowRayQueue, sampler, scratch, gBuffer, features));
+                    rowSelected.push_back(std::move(selected));
+                    rowCombined.push_back(combined);
+                } else {
+                    Reservoir<Capacity>::combineBiased(selected, combined, sampler, scratch, gBuffer);
+                    writeGrid->view(x, y).storeSamples(combined);
+                }
+            }
+
+            // Trace the row's visibility checks at once, then finish its unbiased combinations
+            if (features.unbiasedCombination) {
+                shadowRayQueue.flush();
+                for (size_t rowIdx = 0ULL; rowIdx < rowCombined.size(); rowIdx++) {
+                    Reservoir<Capacity>::finishUnbiased(rowSelected[rowIdx], rowCombined[rowIdx], shadowRayQueue, rowFirstSlots[rowIdx], gBuffer, features);
+                    writeGrid->view(static_cast<int>(rowIdx), y).storeSamples(rowCombined[rowIdx]);
+                }
             }
             #pragma omp critical
             progressBarPixels.update();
         }
         std::cout << std::endl;
-        prevIteration = reservoirGrid;
+        std::swap(readGrid, writeGrid);
+    }
+
+    // The last pass' results are in the read grid, exchanging the grids' buffers keeps both alive
+    if (readGrid != &reservoirGrid) { std::swap(reservoirGrid, otherGrid); }
+}
+
+template <size_t Capacity>
+static size_t totalSampleNums(const ReservoirGrid<Capacity>& reservoirGrid, size_t pixelIdx) {
+    const std::span<const size_t> sampleNums = std::span(reservoirGrid.sampleNums).subspan(pixelIdx * reservoirGrid.numSamples, reservoirGrid.numSamples);
+    return std::accumulate(sampleNums.begin(), sampleNums.end(), 0ULL);
+}
+
+// Clamp M and wSum values of the temporal predecessors to a user-defined multiple of the current frame's to bound temporal creep.
+// Only touches sample counts and weight sums, which are streamed directly from the grids' arrays
+template <size_t Capacity>
+static void clampTemporalM(const ReservoirGrid<Capacity>& reservoirGrid, ReservoirGrid<Capacity>& previousFrameGrid, uint32_t temporalClampM) {
+    const size_t predecessorNumSamples = previousFrameGrid.numSamples;
+    #ifdef NDEBUG
+    #pragma omp parallel for
+    #endif
+    for (size_t pixelIdx = 0ULL; pixelIdx < reservoirGrid.numPixels(); pixelIdx++) {
+        const size_t multipleCurrentM = (temporalClampM * totalSampleNums(reservoirGrid, pixelIdx)) + 1ULL;
+        if (totalSampleNums(previousFrameGrid, pixelIdx) <= multipleCurrentM) { continue; }
+        const std::span<size_t> predecessorM    = std::span(previousFrameGrid.sampleNums).subspan(pixelIdx * predecessorNumSamples, predecessorNumSamples);
+        const std::span<float> predecessorWSums = std::span(previousFrameGrid.wSums).subspan(pixelIdx * predecessorNumSamples, predecessorNumSamples);
+        for (size_t reservoirIdx = 0ULL; reservoirIdx < predecessorNumSamples; reservoirIdx++) {
+            if (predecessorM[reservoirIdx] == 0ULL) { continue; } // Samples processed by this reservoir might be zero
+            predecessorWSums[reservoirIdx]  *= multipleCurrentM / predecessorM[reservoirIdx];
+            predecessorM[reservoirIdx]      = multipleCurrentM;
+        }
+    }
+}
+
+// Compact history has no weight sums, combining does not read those of its input reservoirs anyway
+template <size_t Capacity>
+static void clampTemporalM(const ReservoirGrid<Capacity>& reservoirGrid, CompactReservoirGrid& previousFrameGrid, uint32_t temporalClampM) {
+    const size_t predecessorNumSamples = previousFrameGrid.numSamples;
+    #ifdef NDEBUG
+    #pragma omp parallel for
+    #endif
+    for (size_t pixelIdx = 0ULL; pixelIdx < reservoirGrid.numPixels(); pixelIdx++) {
+        const size_t multipleCurrentM                   = (temporalClampM * totalSampleNums(reservoirGrid, pixelIdx)) + 1ULL;
+        const std::span<CompactSample> predecessors     = std::span(previousFrameGrid.samples).subspan(pixelIdx * predecessorNumSamples, predecessorNumSamples);
+        size_t predecessorM = 0ULL;
+        for (const CompactSample& predecessor : predecessors) { predecessorM += predecessor.sampleNum; }
+        if (predecessorM <= multipleCurrentM) { continue; }
+        for (CompactSample& predecessor : predecessors) {
+            if (predecessor.sampleNum == 0U) { continue; } // Samples processed by this reservoir might be zero
+            predecessor.sampleNum = static_cast<uint16_t>(std::min<size_t>(multipleCurrentM, std::numeric_limits<uint16_t>::max()));
+        }
     }
 }
 
-void temporalReuse(ReservoirGrid& reservoirGrid, ReservoirGrid& previousFrameGrid, const EmbreeInterface& embreeInterface,
-                   Screen& screen, const Features& features) {
+// View of the temporal predecessor of a pixel. Compact history is expanded into the given scratch row first. Predecessors' pixel
+// indices refer to the previous frame's G-buffer, which biased combination never reads
+template <size_t Capacity>
+static ConstReservoirView<Capacity> predecessorView(const ReservoirGrid<Capacity>& previousFrameGrid, int x, int y, ReservoirGrid<Capacity>&, const Scene&) {
+    return previousFrameGrid.view(x, y);
+}
+
+template <size_t Capacity>
+static ConstReservoirView<Capacity> predecessorView(const CompactReservoirGrid& previousFrameGrid, int x, int y, ReservoirGrid<Capacity>& scratchRow,
+                                                    const Scene& scene) {
+    scratchRow.view(x, 0).storeSamples(previousFrameGrid.load<Capacity>(x, y, scene));
+    return std::as_const(scratchRow).view(x, 0);
+}
+
+template <size_t Capacity, typename History>
+void temporalReuse(ReservoirGrid<Capacity>& reservoirGrid, History& previousFrameGrid, const GBuffer& gBuffer, const Scene& scene,
+                   Screen& screen, const Features& features, uint32_t frameIdx) {
     glm::ivec2 windowResolution = screen.resolution();
+    clampTemporalM(std::as_const(reservoirGrid), previousFrameGrid, features.temporalClampM);
 
     std::cout << "Temporal reuse..." << std::endl;
     progressbar progressBarPixels(windowResolution.y);
@@ -149,26 +317,18 @@ void temporalReuse(ReservoirGrid& reservoirGrid, ReservoirGrid& previousFrameGri
     #pragma omp parallel for schedule(guided)
     #endif
     for (int y = 0; y < windowResolution.y; y++) {
+        const int scratchWidth = std::is_same_v<History, CompactReservoirGrid> ? windowResolution.x : 0;
+        ReservoirGrid<Capacity> scratchRow(glm::ivec2(scratchWidth, 1), previousFrameGrid.numSamples);
+        ResamplingScratch scratch;
         for (int x = 0; x != windowResolution.x; x++) {
-            // Clamp M and wSum values to a user-defined multiple of the current frame's to bound temporal creep
-            Reservoir& current              = reservoirGrid[y][x];
-            Reservoir& temporalPredecessor  = previousFrameGrid[y][x];
-            size_t multipleCurrentM         = (features.temporalClampM * current.totalSampleNums()) + 1ULL;
-            if (temporalPredecessor.totalSampleNums() > multipleCurrentM) {
-                for (size_t reservoirIdx = 0ULL; reservoirIdx < temporalPredecessor.outputSamples.size(); reservoirIdx++) {
-                    if (temporalPredecessor.sampleNums[reservoirIdx] == 0ULL) { continue; } // Samples processed by this reservoir might be zero
-                    temporalPredecessor.wSums[reservoirIdx]         *= multipleCurrentM / temporalPredecessor.sampleNums[reservoirIdx];
-                    temporalPredecessor.sampleNums[reservoirIdx]    = multipleCurrentM;
-                }
-            }
-
-            // Combine to single reservoir
-            Reservoir combined(current.outputSamples.size());
-            combined.cameraRay                              = current.cameraRay;
-            combined.hitInfo                                = current.hitInfo;
-            std::array<Reservoir, 2ULL> pixelAndPredecessor = { current, temporalPredecessor };
-            Reservoir::combineBiased(pixelAndPredecessor, combined, features); // Samples from temporal predecessor should be visible, no need to do unbiased combination
-            reservoirGrid[y][x]                             = combined;
+            // Combine to single reservoir, read in place from both grids
+            const ConstReservoirView<Capacity> current                              = std::as_const(reservoirGrid).view(x, y);
+            Reservoir<Capacity> combined(current.size());
+            combined.pixelIdx                                                       = current.pixelIdx;
+            const std::array<ConstReservoirView<Capacity>, 2ULL> pixelAndPredecessor = { current, predecessorView(std::as_const(previousFrameGrid), x, y, scratchRow, scene) };
+            Sampler sampler(glm::ivec2(x, y), frameIdx, SampleStream::TemporalReuse, 0U, features.sampleSequence);
+            Reservoir<Capacity>::combineBiased(pixelAndPredecessor, combined, sampler, scratch, gBuffer); // Samples from temporal predecessor should be visible, no need to do unbiased combination
+            reservoirGrid.view(x, y).storeSamples(combined);
         }
         #pragma omp critical
         progressBarPixels.update();
@@ -176,13 +336,34 @@ void temporalReuse(ReservoirGrid& reservoirGrid, ReservoirGrid& previousFrameGri
     std::cout << std::endl;
 }
 
-float generalisedBalanceHeuristic(const LightSample& sample, const std::vector<Reservoir>& allPixels,
-                                  const Ray& primaryRay, const HitInfo& primaryHitInfo,
-                                  const Features& features) {
-    // Redundant computation in denominator, but sufficient for a quick and dirty prototype
-    float numerator     = targetPDF(sample, primaryRay, primaryHitInfo, features);
+template <size_t Capacity>
+TargetPDFMatrix neighbourhoodTargetPDFs(const std::vector<Reservoir<Capacity>>& neighbourhood, const GBuffer& gBuffer) {
+    std::vector<SampleData> neighbourhoodSamples;
+    for (const Reservoir<Capacity>& pixel : neighbourhood) { neighbourhoodSamples.insert(neighbourhoodSamples.end(), pixel.samples().begin(), pixel.samples().end()); }
+
+    // Batched evaluation of the other pixels' samples per shading point, in terms of the target function of that pixel's reservoir.
+    // A pixel's own samples have their target function cached
+    TargetPDFMatrix targets(neighbourhood.size(), std::vector<float>(neighbourhoodSamples.size()));
+    size_t ownSamplesBegin = 0ULL;
+    for (size_t pixelIdx = 0ULL; pixelIdx < neighbourhood.size(); pixelIdx++) {
+        const Reservoir<Capacity>& pixel    = neighbourhood[pixelIdx];
+        const size_t ownSamplesEnd          = ownSamplesBegin + pixel.size();
+        const ShadingPoint shadingPoint     = gBuffer.shadingPoint(pixel.pixelIdx);
+        const std::span<const SampleData> samples(neighbourhoodSamples);
+        const std::span<float> pixelTargets(targets[pixelIdx]);
+        targetPDFs(samples.first(ownSamplesBegin), shadingPoint, pixelTargets.first(ownSamplesBegin), pixel.targetFunction);
+        targetPDFs(samples.subspan(ownSamplesEnd), shadingPoint, pixelTargets.subspan(ownSamplesEnd), pixel.targetFunction);
+        for (size_t sampleIdx = 0ULL; sampleIdx < pixel.size(); sampleIdx++) { pixelTargets[ownSamplesBegin + sampleIdx] = pixel.outputSamples[sampleIdx].targetPdf; }
+        ownSamplesBegin = ownSamplesEnd;
+    }
+    return targets;
+}
+
+float generalisedBalanceHeuristic(const TargetPDFMatrix& neighbourhoodTargets, size_t neighbourhoodSampleIdx) {
+    // The primary pixel is always the first of its neighbourhood
+    float numerator     = neighbourhoodTargets[0ULL][neighbourhoodSampleIdx];
     float denominator   = std::numeric_limits<float>::min();
-    for (const Reservoir& pixel : allPixels) { denominator += targetPDF(sample, pixel.cameraRay, pixel.hitInfo, features); }
+    for (const std::vector<float>& pixelTargets : neighbourhoodTargets) { denominator += pixelTargets[neighbourhoodSampleIdx]; }
     return numerator / denominator;
 }
 
@@ -242,16 +423,27 @@ void visualiseAlphas(const MatrixGrid& techniqueMatrices,
     }
 }
 
-float arbitraryUnbiasedContributionWeightReciprocal(const LightSample& sample, const Reservoir& pixel, const Scene& scene,
-                                                    size_t sampleIdx,
-                                                    const Features& features) {
-    float targetPdfValue = targetPDF(sample, pixel.cameraRay, pixel.hitInfo, features);
+template <size_t Capacity>
+float arbitraryUnbiasedContributionWeightReciprocal(const LightSample& sample, float targetPdfValue, const Reservoir<Capacity>& pixel, const GBuffer& gBuffer,
+                                                    const LightSampler& lightSampler, size_t sampleIdx) {
     if (targetPdfValue == 0.0f) { return 0.0f; } // If target function value is zero, theoretical normalised PDF would also be zero
 
     // Compute mock unbiased contribution weight
-    float mockSampleWeight  = targetPdfValue / (1.0f / scene.lights.size()); // Samples all generated via uniform light sampling, so equal original PDF
+    float mockSampleWeight  = targetPdfValue / lightSampler.pdf(sample.lightIdx, gBuffer.positions[pixel.pixelIdx], gBuffer.normal(pixel.pixelIdx)); // Source PDF of the given pixel's distribution
     float arbitraryWeight   = (1.0f / targetPdfValue) *
                               (1.0f / pixel.sampleNums[sampleIdx]) * // Account for MIS weights in unbiased contribution because that's how it is in the rest of the codebas
                               (pixel.wSums[sampleIdx] - pixel.chosenSampleWeights[sampleIdx] + mockSampleWeight); // Emulate replacing weight of chosen sample with the given sample
     return (1.0f / arbitraryWeight);
 }
+
+#define INSTANTIATE_RENDER_UTILS(CAPACITY) \
+    template ReservoirGrid<CAPACITY> genInitialSamples(const GBuffer&, const Scene&, const LightSampler&, const EmbreeInterface&, const Features&, \
+                                                       const glm::ivec2&, uint32_t, uint32_t); \
+    template glm::vec3 finalShading(const ConstReservoirView<CAPACITY>&, const ShadowRayQueue&, size_t, const GBuffer&); \
+    template void spatialReuse(ReservoirGrid<CAPACITY>&, AnyReservoirGrid&, const GBuffer&, const EmbreeInterface&, const Screen&, const Features&, uint32_t); \
+    template void temporalReuse(ReservoirGrid<CAPACITY>&, ReservoirGrid<CAPACITY>&, const GBuffer&, const Scene&, Screen&, const Features&, uint32_t); \
+    template void temporalReuse(ReservoirGrid<CAPACITY>&, CompactReservoirGrid&, const GBuffer&, const Scene&, Screen&, const Features&, uint32_t); \
+    template TargetPDFMatrix neighbourhoodTargetPDFs(const std::vector<Reservoir<CAPACITY>>&, const GBuffer&); \
+    template float arbitraryUnbiasedContributionWeightReciprocal(const LightSample&, float, const Reservoir<CAPACITY>&, const GBuffer&, const LightSampler&, size_t);
+FOR_EACH_RESERVOIR_CAPACITY(INSTANTIATE_RENDER_UTILS)
+#undef INSTANTIATE_RENDER_UTILS
@@ -8,8 +8,12 @@ DISABLE_WARNINGS_POP()
 
 #include <framework/trackball.h>
 
+#include <ray_tracing/shadow_ray_queue.h>
+#include <scene/light_sampler.h>
 #include <scene/scene.h>
+#include <rendering/g_buffer.h>
 #include <rendering/reservoir.h>
+#include <rendering/reservoir_grid.h>
 #include <rendering/screen.h>
 
 
@@ -19,26 +23,42 @@ enum class Color {
     Blue
 };
 
+constexpr int32_t PRIMARY_TILE_HEIGHT = 8; // Height of the screen tiles traced together in the primary rays pass (width is one ray packet)
+
 using PrimaryHitGrid    = std::vector<std::vector<RayHit>>;
 using MatrixGrid        = std::vector<std::vector<Eigen::MatrixXf>>;
 using VectorGrid        = std::vector<std::vector<Eigen::VectorXf>>;
 using PixelGrid         = std::vector<std::vector<glm::vec3>>;
+using TargetPDFMatrix   = std::vector<std::vector<float>>;
 
 // Common
 PrimaryHitGrid genPrimaryRayHits(const Scene& scene, const Trackball& camera, const EmbreeInterface& embreeInterface, const Screen& screen, const Features& features);
-ReservoirGrid genInitialSamples(const PrimaryHitGrid& primaryHits, const Scene& scene, const EmbreeInterface& embreeInterface, const Features& features, const glm::ivec2& windowResolution);
-glm::vec3 finalShading(const Reservoir& reservoir, const Ray& primaryRay, const EmbreeInterface& embreeInterface, const Features& features);
+GBuffer genGBuffer(const PrimaryHitGrid& primaryHits, const Scene& scene, const Features& features, const glm::ivec2& windowResolution);
+template <size_t Capacity>
+ReservoirGrid<Capacity> genInitialSamples(const GBuffer& gBuffer, const Scene& scene, const LightSampler& lightSampler, const EmbreeInterface& embreeInterface,
+                                          const Features& features, const glm::ivec2& windowResolution,
+                                          uint32_t frameIdx, uint32_t pass = 0U);
+template <size_t Capacity>
+glm::vec3 finalShading(const ConstReservoirView<Capacity>& reservoir, const ShadowRayQueue& shadowRayQueue, size_t firstSlot, const GBuffer& gBuffer);
 void combineToScreen(Screen& screen, const PixelGrid& finalPixelColors, const Features& features);
 
 // ReSTIR-specific
-void spatialReuse(ReservoirGrid& reservoirGrid, const EmbreeInterface& embreeInterface, const Screen& screen, const Features& features);
-void temporalReuse(ReservoirGrid& reservoirGrid, ReservoirGrid& previousFrameGrid, const EmbreeInterface& embreeInterface,
-                   Screen& screen, const Features& features);
+// Passes alternate between the frame's grid and the swap grid, which the caller keeps alive across frames so neither is reallocated
+template <size_t Capacity>
+void spatialReuse(ReservoirGrid<Capacity>& reservoirGrid, AnyReservoirGrid& swapGrid, const GBuffer& gBuffer, const EmbreeInterface& embreeInterface,
+                  const Screen& screen, const Features& features, uint32_t frameIdx);
+// The previous frame's grid is either a ReservoirGrid of the same capacity or a CompactReservoirGrid
+template <size_t Capacity, typename History>
+void temporalReuse(ReservoirGrid<Capacity>& reservoirGrid, History& previousFrameGrid, const GBuffer& gBuffer, const Scene& scene,
+                   Screen& screen, const Features& features, uint32_t frameIdx);
+
+// R-MIS and R-OMIS
+// Target function of every sample of a neighbourhood (numbered in reservoir order) at the shading point of every neighbourhood pixel, indexed [pixel][sample]
+template <size_t Capacity>
+TargetPDFMatrix neighbourhoodTargetPDFs(const std::vector<Reservoir<Capacity>>& neighbourhood, const GBuffer& gBuffer);
 
 // R-MIS-specific
-float generalisedBalanceHeuristic(const LightSample& sample, const std::vector<Reservoir>& allPixels,
-                                  const Ray& primaryRay, const HitInfo& primaryHitInfo,
-                                  const Features& features);
+float generalisedBalanceHeuristic(const TargetPDFMatrix& neighbourhoodTargets, size_t neighbourhoodSampleIdx);
 
 // R-OMIS-specific
 void visualiseAlphas(const MatrixGrid& techniqueMatrices,
@@ -46,9 +66,9 @@ void visualiseAlphas(const MatrixGrid& techniqueMatrices,
                      const VectorGrid& contributionVectorsGreen,
                      const VectorGrid& contributionVectorsBlue,
                      const glm::ivec2& windowResolution, const Features& features);
-float arbitraryUnbiasedContributionWeightReciprocal(const LightSample& sample, const Reservoir& pixel, const Scene& scene,
-                                                    size_t sampleIdx,
-                                                    const Features& features);
+template <size_t Capacity>
+float arbitraryUnbiasedContributionWeightReciprocal(const LightSample& sample, float targetPdfValue, const Reservoir<Capacity>& pixel, const GBuffer& gBuffer,
+                                                    const LightSampler& lightSampler, size_t sampleIdx);
 inline Eigen::VectorXf solveSystem(const Eigen::MatrixXf& A, const Eigen::VectorXf& b) { return A.completeOrthogonalDecomposition().solve(b); }
 
 
@@ -7,11 +7,18 @@ DISABLE_WARNINGS_POP()
 #include <rendering/shading.h>
 #include <utils/utils.h>
 
-size_t Reservoir::update(LightSample sample, float weight) {
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <numeric>
+#include <utility>
+
+template <size_t Capacity>
+size_t Reservoir<Capacity>::update(LightSample sample, float weight, float targetPdf, Sampler& sampler) {
     // Find reservoir with smallest weight sum
     size_t smallestWeightIdx    = 0ULL;
     float smallestWeight        = std::numeric_limits<float>::max();
-    for (size_t reservoirIdx = 0ULL; reservoirIdx < wSums.size(); reservoirIdx++) {
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < numSamples; reservoirIdx++) {
         if (wSums[reservoirIdx] < smallestWeight) {
             smallestWeightIdx   = reservoirIdx;
             smallestWeight      = wSums[reservoirIdx];
@@ -21,43 +28,118 @@ size_t Reservoir::update(LightSample sample, float weight) {
     // Selected reservoir processes sample
     sampleNums[smallestWeightIdx]   += 1ULL;
     wSums[smallestWeightIdx]        += weight;
-    float uniformRandom             = linearMap(static_cast<float>(rand()), 0.0f, RAND_MAX, 0.0f, 1.0f);
+    float uniformRandom             = sampler.nextRandom1D();
     if (uniformRandom < (weight / wSums[smallestWeightIdx] )) { 
-        outputSamples[smallestWeightIdx].lightSample.position   = sample.position;
-        outputSamples[smallestWeightIdx].lightSample.color      = sample.color;
+        outputSamples[smallestWeightIdx].lightSample            = sample;
+        outputSamples[smallestWeightIdx].targetPdf              = targetPdf;
         chosenSampleWeights[smallestWeightIdx]                  = weight;
     }
 
     return smallestWeightIdx;
 }
 
-size_t Reservoir::totalSampleNums() const {
+template <size_t Capacity>
+void Reservoir<Capacity>::updateBatch(std::span<const LightSample> samples, std::span<const float> weights, std::span<const float> targetPdfs, Sampler& sampler,
+                                      std::span<size_t> assignments, std::span<float> prefixSums, std::span<uint32_t> groupedIdxs) {
+    // Assignment to the sub-reservoir with the smallest weight sum only depends on the weights, not on earlier selections.
+    // Group sizes are counted along the way
+    std::array<float, Capacity> runningWSums    = wSums;
+    std::array<size_t, Capacity> groupSizes     {};
+    for (size_t sampleIdx = 0ULL; sampleIdx < samples.size(); sampleIdx++) {
+        size_t smallestWeightIdx = 0ULL;
+        for (size_t reservoirIdx = 1ULL; reservoirIdx < numSamples; reservoirIdx++) {
+            if (runningWSums[reservoirIdx] < runningWSums[smallestWeightIdx]) { smallestWeightIdx = reservoirIdx; }
+        }
+        runningWSums[smallestWeightIdx] += weights[sampleIdx];
+        assignments[sampleIdx]          = smallestWeightIdx;
+        groupSizes[smallestWeightIdx]++;
+    }
+
+    // Scatter the weights into contiguous per sub-reservoir groups, in sample order within each group
+    std::array<size_t, Capacity> groupOffsets {};
+    std::exclusive_scan(groupSizes.begin(), groupSizes.end(), groupOffsets.begin(), 0ULL);
+    std::array<size_t, Capacity> groupCursors = groupOffsets;
+    for (size_t sampleIdx = 0ULL; sampleIdx < samples.size(); sampleIdx++) {
+        const size_t groupedIdx = groupCursors[assignments[sampleIdx]]++;
+        prefixSums[groupedIdx]  = weights[sampleIdx];
+        groupedIdxs[groupedIdx] = static_cast<uint32_t>(sampleIdx);
+    }
+
+    // Every sub-reservoir draws once against the prefix sum of its current weight sum followed by the weights of its new samples
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < numSamples; reservoirIdx++) {
+        if (groupSizes[reservoirIdx] == 0ULL) { continue; }
+        const std::span<float> groupSums = prefixSums.subspan(groupOffsets[reservoirIdx], groupSizes[reservoirIdx]);
+        std::inclusive_scan(groupSums.begin(), groupSums.end(), groupSums.begin(), std::plus<float>(), wSums[reservoirIdx]);
+
+        // The current sample is kept if the draw falls within its weight sum, otherwise the first new sample whose prefix sum exceeds the draw wins
+        const float target = sampler.nextRandom1D() * groupSums.back();
+        if (target >= wSums[reservoirIdx]) {
+            const size_t memberIdx                  = std::min<size_t>(static_cast<size_t>(std::upper_bound(groupSums.begin(), groupSums.end(), target) - groupSums.begin()),
+                                                               groupSums.size() - 1ULL);
+            const uint32_t sampleIdx                = groupedIdxs[groupOffsets[reservoirIdx] + memberIdx];
+            outputSamples[reservoirIdx].lightSample = samples[sampleIdx];
+            outputSamples[reservoirIdx].targetPdf   = targetPdfs[sampleIdx];
+            chosenSampleWeights[reservoirIdx]       = weights[sampleIdx];
+        }
+        sampleNums[reservoirIdx]    += groupSizes[reservoirIdx];
+        wSums[reservoirIdx]         = groupSums.back();
+    }
+}
+
+template <size_t Capacity>
+size_t Reservoir<Capacity>::totalSampleNums() const {
     size_t sampleCountSum = 0ULL;
-    for (size_t sampleNum : sampleNums) { sampleCountSum += sampleNum; }
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < numSamples; reservoirIdx++) { sampleCountSum += sampleNums[reservoirIdx]; }
     return sampleCountSum;
 }
 
-void Reservoir::combineBiased(const std::span<Reservoir>& reservoirStream, Reservoir& finalReservoir, const Features& features) {
-    // Process reservoir stream sample-by-sample
-    std::vector<size_t> totalSampleCounts(finalReservoir.outputSamples.size(), 0ULL);
-    for (const Reservoir& reservoir : reservoirStream) {
-        for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.outputSamples.size(); sampleIdx++) {
-            float pdfValue = targetPDF(reservoir.outputSamples[sampleIdx].lightSample,
-                                       finalReservoir.cameraRay, finalReservoir.hitInfo,
-                                       features);
-            size_t updatedFinalReservoirIdx = finalReservoir.update(
-                reservoir.outputSamples[sampleIdx].lightSample,
-                pdfValue * reservoir.outputSamples[sampleIdx].outputWeight * reservoir.sampleNums[sampleIdx]);
-            totalSampleCounts[updatedFinalReservoirIdx] += reservoir.sampleNums[sampleIdx];
+// Stream every sample of the given reservoirs through the final reservoir, with all target function values evaluated up front in batches
+template <size_t Capacity>
+static void streamSamples(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir<Capacity>& finalReservoir, const ShadingPoint& shadingPoint,
+                          Sampler& sampler, ResamplingScratch& scratch) {
+    finalReservoir.targetFunction = TargetFunction::Phong;
+    size_t streamSize = 0ULL;
+    for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) { streamSize += reservoir.size(); }
+    scratch.resize(streamSize);
+    const std::span<LightSample> streamLightSamples = std::span(scratch.samples).first(streamSize);
+    const std::span<float> pdfValues                = std::span(scratch.targetPdfs).first(streamSize);
+    const std::span<float> weights                  = std::span(scratch.weights).first(streamSize);
+    const std::span<size_t> assignments             = std::span(scratch.assignments).first(streamSize);
+    size_t streamIdx = 0ULL;
+    for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) {
+        for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.size(); sampleIdx++, streamIdx++) { streamLightSamples[streamIdx] = reservoir.lightSample(sampleIdx); }
+    }
+    targetPDFs(std::span<const LightSample>(streamLightSamples), shadingPoint, pdfValues);
+
+    // Weigh every sample by its contribution weight and the number of samples it represents, then process the whole stream at once
+    streamIdx = 0ULL;
+    for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) {
+        for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.size(); sampleIdx++, streamIdx++) {
+            weights[streamIdx] = pdfValues[streamIdx] * reservoir.outputWeights[sampleIdx] * static_cast<float>(reservoir.sampleNums[sampleIdx]);
         }
     }
-    finalReservoir.sampleNums = std::move(totalSampleCounts);
+    finalReservoir.updateBatch(streamLightSamples, weights, pdfValues, sampler, assignments, std::span(scratch.prefixSums).first(streamSize),
+                               std::span(scratch.groupedIdxs).first(streamSize));
+
+    std::array<size_t, Capacity> totalSampleCounts {};
+    streamIdx = 0ULL;
+    for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) {
+        for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.size(); sampleIdx++, streamIdx++) {
+            totalSampleCounts[assignments[streamIdx]] += reservoir.sampleNums[sampleIdx];
+        }
+    }
+    finalReservoir.sampleNums = totalSampleCounts;
+}
+
+template <size_t Capacity>
+void Reservoir<Capacity>::combineBiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir, Sampler& sampler,
+                                        ResamplingScratch& scratch, const GBuffer& gBuffer) {
+    const ShadingPoint shadingPoint = gBuffer.shadingPoint(finalReservoir.pixelIdx);
+    streamSamples(reservoirStream, finalReservoir, shadingPoint, sampler, scratch);
 
     // Compute unbiased constribution weights for each sample in the final reservoir
-    for (size_t reservoirIdx = 0ULL; reservoirIdx < finalReservoir.outputSamples.size(); reservoirIdx++) {
-        float finalPdfValue = targetPDF(finalReservoir.outputSamples[reservoirIdx].lightSample,
-                                        finalReservoir.cameraRay, finalReservoir.hitInfo,
-                                        features);
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < finalReservoir.size(); reservoirIdx++) {
+        float finalPdfValue = finalReservoir.outputSamples[reservoirIdx].targetPdf;
         if (finalPdfValue == 0.0f)  { finalReservoir.outputSamples[reservoirIdx].outputWeight = 0.0f; }
         else                        { finalReservoir.outputSamples[reservoirIdx].outputWeight = (1.0f / finalPdfValue) * 
                                                                                                 (1.0f / finalReservoir.sampleNums[reservoirIdx]) *
@@ -65,37 +147,44 @@ void Reservoir::combineBiased(const std::span<Reservoir>& reservoirStream, Reser
     }
 }
 
-void Reservoir::combineUnbiased(const std::span<Reservoir>& reservoirStream, Reservoir& finalReservoir, const EmbreeInterface& embreeInterface, const Features& features) {
-    // Process reservoir stream sample-by-sample
-    std::vector<size_t> totalSampleCounts(finalReservoir.outputSamples.size(), 0ULL);
-    for (const Reservoir& reservoir : reservoirStream) {
-        for (size_t sampleIdx = 0ULL; sampleIdx < reservoir.outputSamples.size(); sampleIdx++) {
-            float pdfValue = targetPDF(reservoir.outputSamples[sampleIdx].lightSample,
-                                       finalReservoir.cameraRay, finalReservoir.hitInfo,
-                                       features);
-            size_t updatedFinalReservoirIdx = finalReservoir.update(
-                reservoir.outputSamples[sampleIdx].lightSample,
-                pdfValue * reservoir.outputSamples[sampleIdx].outputWeight * reservoir.sampleNums[sampleIdx]);
-            totalSampleCounts[updatedFinalReservoirIdx] += reservoir.sampleNums[sampleIdx];
+template <size_t Capacity>
+size_t Reservoir<Capacity>::combineUnbiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir,
+                                            ShadowRayQueue& shadowRayQueue, Sampler& sampler, ResamplingScratch& scratch, const GBuffer& gBuffer,
+                                            const Features& features) {
+    const ShadingPoint shadingPoint = gBuffer.shadingPoint(finalReservoir.pixelIdx);
+    streamSamples(reservoirStream, finalReservoir, shadingPoint, sampler, scratch);
+
+    // Enqueue all visibility checks needed to validate the final samples in the domains of the input reservoirs
+    const size_t firstSlot = shadowRayQueue.size();
+    if (features.spatialReuseVisibilityCheck) {
+        for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) {
+            for (const SampleData& finalReservoirSample : finalReservoir.samples()) { shadowRayQueue.enqueue(finalReservoirSample.lightSample.position, gBuffer.positions[reservoir.pixelIdx]); }
         }
     }
-    finalReservoir.sampleNums = std::move(totalSampleCounts);
+    return firstSlot;
+}
 
+template <size_t Capacity>
+void Reservoir<Capacity>::finishUnbiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir,
+                                         const ShadowRayQueue& shadowRayQueue, size_t firstSlot, const GBuffer& gBuffer, const Features& features) {
     // Count only samples which have a contribution in the final reservoir's domain for use in the unbiased contribution weights
-    std::vector<size_t> numValidSamples(finalReservoir.outputSamples.size(), 0ULL);
-    for (const Reservoir& reservoir : reservoirStream) {
-        for (size_t outputSampleIdx = 0ULL; outputSampleIdx < finalReservoir.outputSamples.size(); outputSampleIdx++) {
-            const SampleData& finalReservoirSample  = finalReservoir.outputSamples[outputSampleIdx]; 
-            float pdfValue                          = targetPDF(finalReservoirSample.lightSample, reservoir.cameraRay, reservoir.hitInfo, features);
-            if (features.spatialReuseVisibilityCheck)   { pdfValue *= testVisibilityLightSample(finalReservoirSample.lightSample.position, embreeInterface, features, reservoir.cameraRay, reservoir.hitInfo); }
+    std::array<size_t, Capacity> numValidSamples {};
+    std::array<float, Capacity> pdfValues;
+    size_t slot = firstSlot;
+    for (const ConstReservoirView<Capacity>& reservoir : reservoirStream) {
+        targetPDFs(std::as_const(finalReservoir).samples(), gBuffer.shadingPoint(reservoir.pixelIdx), pdfValues,
+                   reservoir.targetFunction);
+        for (size_t outputSampleIdx = 0ULL; outputSampleIdx < finalReservoir.size(); outputSampleIdx++) {
+            float pdfValue                              = pdfValues[outputSampleIdx];
+            if (features.spatialReuseVisibilityCheck)   { pdfValue *= shadowRayQueue.visible(slot++); }
             if (pdfValue > 0.0f)                        { numValidSamples[outputSampleIdx] += reservoir.totalSampleNums(); }
         }
     }
     
     // Compute unbiased constribution weights for each sample in the final reservoir
-    for (size_t outputSampleIdx = 0ULL; outputSampleIdx < finalReservoir.outputSamples.size(); outputSampleIdx++) {
+    for (size_t outputSampleIdx = 0ULL; outputSampleIdx < finalReservoir.size(); outputSampleIdx++) {
         SampleData& finalReservoirSample    = finalReservoir.outputSamples[outputSampleIdx];
-        float finalPdfValue                 = targetPDF(finalReservoirSample.lightSample, finalReservoir.cameraRay, finalReservoir.hitInfo, features);
+        float finalPdfValue                 = finalReservoirSample.targetPdf;
         if (finalPdfValue == 0.0f || numValidSamples[outputSampleIdx] == 0ULL)  { finalReservoirSample.outputWeight = 0.0f; }
         else                                                                    { finalReservoirSample.outputWeight = (1.0f / finalPdfValue) * 
                                                                                                                       (1.0f / numValidSamples[outputSampleIdx]) *
@@ -103,7 +192,44 @@ void Reservoir::combineUnbiased(const std::span<Reservoir>& reservoirStream, Res
     }
 }
 
-float targetPDF(const LightSample& sample, const Ray& cameraRay, const HitInfo& hitInfo, const Features& features) {
-    glm::vec3 bsdf = computeShading(sample.position, sample.color, features, cameraRay, hitInfo);
-    return glm::length(bsdf);
+#define INSTANTIATE_RESERVOIR(CAPACITY) template struct Reservoir<CAPACITY>;
+FOR_EACH_RESERVOIR_CAPACITY(INSTANTIATE_RESERVOIR)
+#undef INSTANTIATE_RESERVOIR
+
+// Transpose samples into SIMD batches. Lanes past the last sample repeat it and their results are discarded
+template <typename Sample, typename Projection>
+static void batchedTargetPDFs(std::span<const Sample> samples, const ShadingPoint& shadingPoint, std::span<float> values, TargetFunction targetFunction,
+                              Projection lightSample) {
+    ShadingBatch batch;
+    std::array<float, simd::LANES> lengths;
+    for (size_t first = 0ULL; first < samples.size(); first += simd::LANES) {
+        const size_t count = std::min(simd::LANES, samples.size() - first);
+        for (size_t lane = 0ULL; lane < simd::LANES; lane++) {
+            const LightSample& sample   = lightSample(samples[first + std::min(lane, count - 1U)]);
+            batch.positionX[lane]       = sample.position.x;
+            batch.positionY[lane]       = sample.position.y;
+            batch.positionZ[lane]       = sample.position.z;
+            batch.colorR[lane]          = sample.color.r;
+            batch.colorG[lane]          = sample.color.g;
+            batch.colorB[lane]          = sample.color.b;
+        }
+        if (targetFunction == TargetFunction::Geometric)    { computeGeometricLengths(shadingPoint, batch, lengths); }
+        else                                                { computeShadingLengths(shadingPoint, batch, lengths); }
+        std::copy_n(lengths.begin(), count, values.begin() + first);
+    }
+}
+
+void targetPDFs(std::span<const LightSample> samples, const ShadingPoint& shadingPoint, std::span<float> values, TargetFunction targetFunction) {
+    batchedTargetPDFs(samples, shadingPoint, values, targetFunction, [](const LightSample& sample) -> const LightSample& { return sample; });
+}
+
+void targetPDFs(std::span<const SampleData> samples, const ShadingPoint& shadingPoint, std::span<float> values, TargetFunction targetFunction) {
+    batchedTargetPDFs(samples, shadingPoint, values, targetFunction, [](const SampleData& sample) -> const LightSample& { return sample.lightSample; });
+}
+
+// Goes through the batched kernel as well, so single and batched evaluations agree exactly
+float targetPDF(const LightSample& sample, const ShadingPoint& shadingPoint) {
+    float value;
+    targetPDFs(std::span(&sample, 1ULL), shadingPoint, std::span(&value, 1ULL));
+    return value;
 }
@@ -3,7 +3,11 @@
 #define _RESERVOIR_H_
 
 #include <ray_tracing/embree_interface.h>
+#include <ray_tracing/shadow_ray_queue.h>
+#include <rendering/g_buffer.h>
+#include <rendering/shading.h>
 #include <utils/common.h>
+#include <utils/sampler.h>
 
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
@@ -11,69 +15,259 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 #include <framework/ray.h>
 
+#include <array>
+#include <format>
 #include <limits>
+#include <numeric>
 #include <span>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 struct LightSample {
     glm::vec3 position  = {0.0f, 0.0f, 0.0f},
               color     = {0.0f, 0.0f, 0.0f};
+    uint32_t lightIdx   = 0U; // Light the sample lies on, identifies its source PDF (see LightSampler)
 };
 
 struct SampleData {
     LightSample lightSample;
-    float outputWeight = 0.0f;
+    float outputWeight  = 0.0f;
+    float targetPdf     = 0.0f; // Unshadowed target function of the sample at the owning reservoir's shading point, in the reservoir's target function
 };
 
+/**
+ * Buffers a batch of resampling candidates is staged in. Kept alive across the pixels of a row and only grown, so batched
+ * updates and combinations do not allocate per pixel. Contents are overwritten by every batch
+*/
+struct ResamplingScratch {
+    std::vector<LightSample> samples;
+    std::vector<float> sourcePdfs;
+    std::vector<float> targetPdfs;
+    std::vector<float> weights;
+    std::vector<size_t> assignments;    // Sub-reservoir each candidate was assigned to
+    std::vector<float> prefixSums;      // Candidate weights grouped by sub-reservoir, scanned in place
+    std::vector<uint32_t> groupedIdxs;  // Candidate indices in the same grouped order
+
+    void resize(size_t numCandidates) {
+        samples.resize(numCandidates);
+        sourcePdfs.resize(numCandidates);
+        targetPdfs.resize(numCandidates);
+        weights.resize(numCandidates);
+        assignments.resize(numCandidates);
+        prefixSums.resize(numCandidates);
+        groupedIdxs.resize(numCandidates);
+    }
+};
+
+// Capacities reservoirs are instantiated with, applies the given macro to each of them. Every frame is rendered with the
+// smallest capacity holding Features::numSamplesInReservoir sub-reservoirs (see reservoirCapacity)
+#define FOR_EACH_RESERVOIR_CAPACITY(MACRO) MACRO(1) MACRO(2) MACRO(4) MACRO(8) MACRO(16) MACRO(32)
+
+template <size_t Capacity, bool Const>
+struct BasicReservoirView;
+template <size_t Capacity>
+using ConstReservoirView = BasicReservoirView<Capacity, true>;
+
+/**
+ * Set of sub-reservoirs with inline storage for up to Capacity of them, of which the first numSamples are in use.
+ * Trivially copyable and allocation-free, so grids of them are single allocations per row and copies are plain memory copies
+*/
+template <size_t Capacity>
 struct Reservoir {
-    Reservoir(size_t numSamples) : outputSamples(numSamples)
-                                 , sampleNums(numSamples, 1ULL)
-                                 , wSums(numSamples, std::numeric_limits<float>::min())
-                                 , chosenSampleWeights(numSamples, 0.0f) {}
+    Reservoir() : Reservoir(Capacity) {}
+    explicit Reservoir(size_t sampleCount) : numSamples(static_cast<uint32_t>(sampleCount)) {
+        if (sampleCount > Capacity) { throw std::runtime_error(std::format("Reservoir of capacity {} cannot hold {} samples", Capacity, sampleCount)); }
+        sampleNums.fill(1ULL);
+        wSums.fill(std::numeric_limits<float>::min());
+        chosenSampleWeights.fill(0.0f);
+    }
 
     // Intersection position info
-    Ray cameraRay;
-    HitInfo hitInfo;
+    uint32_t pixelIdx = 0U; // Pixel whose G-buffer shading point the samples are resampled at
 
     // Light sampling
-    std::vector<SampleData> outputSamples;   
-    std::vector<size_t> sampleNums;
-    std::vector<float> wSums;
-    std::vector<float> chosenSampleWeights;
+    TargetFunction targetFunction = TargetFunction::Phong; // Target function the samples were resampled with, their weights are in its terms
+    uint32_t numSamples;                                    // Sub-reservoirs in use, entries past them are ignored
+    std::array<SampleData, Capacity> outputSamples;
+    std::array<size_t, Capacity> sampleNums;
+    std::array<float, Capacity> wSums;
+    std::array<float, Capacity> chosenSampleWeights;
+
+    size_t size() const { return numSamples; }
+    std::span<SampleData> samples()             { return std::span<SampleData>(outputSamples).first(numSamples); }
+    std::span<const SampleData> samples() const { return std::span<const SampleData>(outputSamples).first(numSamples); }
 
     /**
      * Process the given sample for potential storage by a sub-reservoir
      * 
      * @param sample Light sample
      * @param weight Selection weight of the sample
+     * @param targetPdf Target function of the sample at this reservoir's shading point, cached with the sample if it is selected
+     * @param sampler Random number source of the pixel the reservoir belongs to
      * 
      * @return The index of the sub-reservoir which processed this sample
     */
-    size_t update(LightSample sample, float weight);
+    size_t update(LightSample sample, float weight, float targetPdf, Sampler& sampler);
+
+    /**
+     * Process a batch of samples at once, statistically equivalent to calling update with each of them in order. Samples
+     * are assigned to sub-reservoirs as sequential updates would and grouped per sub-reservoir in a single counting pass,
+     * after which every sub-reservoir selects among its current sample and its new ones with a single uniform value, by
+     * binary search in the prefix sum of their weights. Does not allocate
+     * 
+     * @param samples Light samples
+     * @param weights Selection weight of each sample
+     * @param targetPdfs Target function of each sample at this reservoir's shading point
+     * @param sampler Random number source of the pixel the reservoir belongs to, consumes one independent uniform value per sub-reservoir receiving samples
+     * @param assignments Output, the index of the sub-reservoir which processed each sample
+     * @param prefixSums Scratch of at least as many entries as there are samples
+     * @param groupedIdxs Scratch of at least as many entries as there are samples
+    */
+    void updateBatch(std::span<const LightSample> samples, std::span<const float> weights, std::span<const float> targetPdfs, Sampler& sampler,
+                     std::span<size_t> assignments, std::span<float> prefixSums, std::span<uint32_t> groupedIdxs);
 
     size_t totalSampleNums() const;
 
     /**
      * Combine a number of reservoirs in a single final reservoir in a biased fashion (Algorithm 5 in ReSTIR paper)
      * 
-     * @param reservoirs The reservoirs to be combined
-     * @param finalReservoir Struct where final combined reservoir data will be stored. Should have the intersection position info of the relevant pixel
+     * @param reservoirStream Views of the reservoirs to be combined, read in place from the grids they live in
+     * @param finalReservoir Struct where final combined reservoir data will be stored. Should have the pixel index of the relevant pixel
+     * @param sampler Random number source of the pixel the final reservoir belongs to
+     * @param scratch Buffers the input reservoirs' samples are staged in
+     * @param gBuffer Shading points the reservoirs' pixel indices refer to
+    */
+    static void combineBiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir, Sampler& sampler, ResamplingScratch& scratch,
+                              const GBuffer& gBuffer);
+
+    /**
+     * Combine a number of reservoirs in a single final reservoir in an unbiased fashion (Algorithm 6 in ReSTIR paper). Only
+     * selects the final samples and enqueues their visibility checks, so the checks of many combinations (e.g. a whole row)
+     * can be traced at once. Contribution weights are computed by finishUnbiased once the queue has been flushed
+     * 
+     * @param reservoirStream Views of the reservoirs to be combined, read in place from the grids they live in
+     * @param finalReservoir Struct where final combined reservoir data will be stored. Should have the pixel index of the relevant pixel
+     * @param shadowRayQueue Queue the visibility checks of the combination are enqueued in, if enabled
+     * @param sampler Random number source of the pixel the final reservoir belongs to
+     * @param scratch Buffers the input reservoirs' samples are staged in
+     * @param gBuffer Shading points the reservoirs' pixel indices refer to
      * @param features Features configuration
+     * 
+     * @return Slot of the first enqueued visibility check
     */
-    static void combineBiased(const std::span<Reservoir>& reservoirStream, Reservoir& finalReservoir, const Features& features);
+    static size_t combineUnbiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir, ShadowRayQueue& shadowRayQueue,
+                                  Sampler& sampler, ResamplingScratch& scratch, const GBuffer& gBuffer, const Features& features);
 
     /**
-     * Combine a number of reservoirs in a single final reservoir in an unbiased fashion (Algorithm 6 in ReSTIR paper)
+     * Compute the unbiased contribution weights of a final reservoir produced by combineUnbiased
      * 
-     * @param reservoirs The reservoirs to be combined
-     * @param finalReservoir Struct where final combined reservoir data will be stored. Should have the intersection position info of the relevant pixel
+     * @param reservoirStream Same views the final reservoir was combined from
+     * @param finalReservoir Final reservoir returned by combineUnbiased
+     * @param shadowRayQueue Queue the visibility checks were enqueued in, flushed since
+     * @param firstSlot Slot returned by combineUnbiased
+     * @param gBuffer Shading points the reservoirs' pixel indices refer to
      * @param features Features configuration
     */
-    static void combineUnbiased(const std::span<Reservoir>& reservoirStream, Reservoir& finalReservoir, const EmbreeInterface& embreeInterface, const Features& features);
+    static void finishUnbiased(std::span<const ConstReservoirView<Capacity>> reservoirStream, Reservoir& finalReservoir, const ShadowRayQueue& shadowRayQueue,
+                               size_t firstSlot, const GBuffer& gBuffer, const Features& features);
+};
+
+static_assert(std::is_trivially_copyable_v<Reservoir<1ULL>>, "Reservoirs are copied around as plain memory");
+
+/**
+ * Light view of the reservoir of a single pixel of a ReservoirGrid, referencing the grid's arrays directly. Per-sample
+ * fields are spans over the pixel's sub-reservoirs. Converts to and from a standalone Reservoir for code working on those
+*/
+template <size_t Capacity, bool Const>
+struct BasicReservoirView {
+    template <typename T>
+    using Field = std::conditional_t<Const, const T, T>;
+
+    // Intersection position info
+    Field<uint32_t>& pixelIdx;
+    Field<TargetFunction>& targetFunction;
+
+    // Light sampling
+    std::span<Field<glm::vec3>> positions;
+    std::span<Field<glm::vec3>> colors;
+    std::span<Field<uint32_t>> lightIdxs;
+    std::span<Field<float>> outputWeights;
+    std::span<Field<float>> targetPdfs;
+    std::span<Field<size_t>> sampleNums;
+    std::span<Field<float>> wSums;
+    std::span<Field<float>> chosenSampleWeights;
+
+    size_t size() const { return outputWeights.size(); }
+    size_t totalSampleNums() const { return std::accumulate(sampleNums.begin(), sampleNums.end(), 0ULL); }
+    LightSample lightSample(size_t sampleIdx) const { return { positions[sampleIdx], colors[sampleIdx], lightIdxs[sampleIdx] }; }
+
+    // Gather the pixel's reservoir into a standalone one
+    Reservoir<Capacity> load() const {
+        Reservoir<Capacity> reservoir(size());
+        reservoir.pixelIdx          = pixelIdx;
+        reservoir.targetFunction    = targetFunction;
+        for (size_t sampleIdx = 0ULL; sampleIdx < size(); sampleIdx++) {
+            reservoir.outputSamples[sampleIdx]          = { lightSample(sampleIdx), outputWeights[sampleIdx], targetPdfs[sampleIdx] };
+            reservoir.sampleNums[sampleIdx]             = sampleNums[sampleIdx];
+            reservoir.wSums[sampleIdx]                  = wSums[sampleIdx];
+            reservoir.chosenSampleWeights[sampleIdx]    = chosenSampleWeights[sampleIdx];
+        }
+        return reservoir;
+    }
+
+    // Scatter a standalone reservoir with as many sub-reservoirs as the grid into the pixel's reservoir
+    void store(const Reservoir<Capacity>& reservoir) const requires (!Const) {
+        pixelIdx = reservoir.pixelIdx;
+        storeSamples(reservoir);
+    }
+
+    // Same as store, but leaves intersection position info untouched so other pixels can keep reading it
+    void storeSamples(const Reservoir<Capacity>& reservoir) const requires (!Const) {
+        targetFunction = reservoir.targetFunction;
+        for (size_t sampleIdx = 0ULL; sampleIdx < size(); sampleIdx++) {
+            const SampleData& sample        = reservoir.outputSamples[sampleIdx];
+            positions[sampleIdx]            = sample.lightSample.position;
+            colors[sampleIdx]               = sample.lightSample.color;
+            lightIdxs[sampleIdx]            = sample.lightSample.lightIdx;
+            outputWeights[sampleIdx]        = sample.outputWeight;
+            targetPdfs[sampleIdx]           = sample.targetPdf;
+            sampleNums[sampleIdx]           = reservoir.sampleNums[sampleIdx];
+            wSums[sampleIdx]                = reservoir.wSums[sampleIdx];
+            chosenSampleWeights[sampleIdx]  = reservoir.chosenSampleWeights[sampleIdx];
+        }
+    }
 };
 
-using ReservoirGrid = std::vector<std::vector<Reservoir>>;
+template <size_t Capacity>
+using ReservoirView = BasicReservoirView<Capacity, false>;
+
+// Smallest reservoir capacity holding the given number of samples
+inline size_t reservoirCapacity(size_t numSamples) {
+    #define RESERVOIR_CAPACITY_FITS(CAPACITY) if (numSamples <= CAPACITY) { return CAPACITY; }
+    FOR_EACH_RESERVOIR_CAPACITY(RESERVOIR_CAPACITY_FITS)
+    #undef RESERVOIR_CAPACITY_FITS
+    throw std::runtime_error(std::format("No reservoir capacity holds {} samples", numSamples));
+}
+
+// Call the given generic callable with the reservoir capacity for the given number of samples, as a std::integral_constant
+template <typename Function>
+decltype(auto) dispatchReservoirCapacity(size_t numSamples, Function&& function) {
+    switch (reservoirCapacity(numSamples)) {
+        #define RESERVOIR_CAPACITY_CASE(CAPACITY) case CAPACITY: { return function(std::integral_constant<size_t, CAPACITY>()); }
+        FOR_EACH_RESERVOIR_CAPACITY(RESERVOIR_CAPACITY_CASE)
+        #undef RESERVOIR_CAPACITY_CASE
+        default: { throw std::runtime_error(std::format("Unsupported reservoir capacity for {} samples", numSamples)); }
+    }
+}
 
-float targetPDF(const LightSample& sample, const Ray& cameraRay, const HitInfo& hitInfo, const Features& features);
+// Target function of samples shaded at the given shading point, which only does light-dependent work (see GBuffer). Evaluating
+// several samples at once is considerably cheaper per sample
+// Every resampling stage must compute its contribution weights with the same target function it selected with
+void targetPDFs(std::span<const LightSample> samples, const ShadingPoint& shadingPoint, std::span<float> values,
+                TargetFunction targetFunction = TargetFunction::Phong);
+void targetPDFs(std::span<const SampleData> samples, const ShadingPoint& shadingPoint, std::span<float> values,
+                TargetFunction targetFunction = TargetFunction::Phong);
+float targetPDF(const LightSample& sample, const ShadingPoint& shadingPoint);
 
 #endif
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef _RESERVOIR_GRID_H_
+#define _RESERVOIR_GRID_H_
+
+#include <rendering/compact_reservoir.h>
+#include <rendering/reservoir.h>
+#include <utils/common.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+/**
+ * Reservoirs of a whole frame in structure-of-arrays form, with one frame-sized array per field. Sub-reservoir i of the
+ * pixel with index p lives at p * numSamples + i, so passes touching a single field (e.g. weights or sample counts)
+ * stream through dense memory. Individual pixels are accessed through views
+*/
+template <size_t Capacity>
+struct ReservoirGrid {
+    ReservoirGrid(const glm::ivec2& gridResolution, size_t samplesPerPixel)
+        : resolution(gridResolution)
+        , numSamples(samplesPerPixel)
+        , pixelIdxs(numPixels(), 0U)
+        , targetFunctions(numPixels(), TargetFunction::Phong)
+        , positions(numPixels() * numSamples, glm::vec3(0.0f))
+        , colors(numPixels() * numSamples, glm::vec3(0.0f))
+        , lightIdxs(numPixels() * numSamples, 0U)
+        , outputWeights(numPixels() * numSamples, 0.0f)
+        , targetPdfs(numPixels() * numSamples, 0.0f)
+        , sampleNums(numPixels() * numSamples, 1ULL)
+        , wSums(numPixels() * numSamples, std::numeric_limits<float>::min())
+        , chosenSampleWeights(numPixels() * numSamples, 0.0f) {}
+
+    glm::ivec2 resolution;
+    size_t numSamples;  // Sub-reservoirs per pixel
+
+    // Intersection position info, per pixel
+    std::vector<uint32_t> pixelIdxs;
+    std::vector<TargetFunction> targetFunctions;
+
+    // Light sampling, per sub-reservoir
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors;
+    std::vector<uint32_t> lightIdxs;
+    std::vector<float> outputWeights;
+    std::vector<float> targetPdfs;
+    std::vector<size_t> sampleNums;
+    std::vector<float> wSums;
+    std::vector<float> chosenSampleWeights;
+
+    size_t numPixels() const { return static_cast<size_t>(resolution.x) * static_cast<size_t>(resolution.y); }
+    size_t pixelIndex(int x, int y) const { return (static_cast<size_t>(y) * static_cast<size_t>(resolution.x)) + static_cast<size_t>(x); }
+
+    ReservoirView<Capacity> view(int x, int y)              { return makeView(*this, pixelIndex(x, y)); }
+    ConstReservoirView<Capacity> view(int x, int y) const   { return makeView(*this, pixelIndex(x, y)); }
+
+    // Encode the grid's reservoirs in compact form
+    CompactReservoirGrid compact(const Scene& scene) const {
+        CompactReservoirGrid compactGrid { resolution, numSamples, targetFunctions, std::vector<CompactSample>(outputWeights.size()) };
+        #ifdef NDEBUG
+        #pragma omp parallel for
+        #endif
+        for (size_t idx = 0ULL; idx < outputWeights.size(); idx++) {
+            compactGrid.samples[idx] = compactSample({ positions[idx], colors[idx], lightIdxs[idx] }, outputWeights[idx], sampleNums[idx], scene);
+        }
+        return compactGrid;
+    }
+
+private:
+    template <typename Grid>
+    static BasicReservoirView<Capacity, std::is_const_v<Grid>> makeView(Grid& grid, size_t pixelIdx) {
+        const size_t first = pixelIdx * grid.numSamples;
+        return { grid.pixelIdxs[pixelIdx], grid.targetFunctions[pixelIdx],
+                 std::span(grid.positions).subspan(first, grid.numSamples),
+                 std::span(grid.colors).subspan(first, grid.numSamples),
+                 std::span(grid.lightIdxs).subspan(first, grid.numSamples),
+                 std::span(grid.outputWeights).subspan(first, grid.numSamples),
+                 std::span(grid.targetPdfs).subspan(first, grid.numSamples),
+                 std::span(grid.sampleNums).subspan(first, grid.numSamples),
+                 std::span(grid.wSums).subspan(first, grid.numSamples),
+                 std::span(grid.chosenSampleWeights).subspan(first, grid.numSamples) };
+    }
+};
+
+// Grid of any capacity or in compact form, e.g. the previous frame's grid kept for temporal reuse
+#define RESERVOIR_GRID_ALTERNATIVE(CAPACITY) , ReservoirGrid<CAPACITY>
+using AnyReservoirGrid = std::variant<std::monostate, CompactReservoirGrid FOR_EACH_RESERVOIR_CAPACITY(RESERVOIR_GRID_ALTERNATIVE)>;
+#undef RESERVOIR_GRID_ALTERNATIVE
+
+#endif // _RESERVOIR_GRID_H_
@@ -4,31 +4,33 @@
 #include <cmath>
 #include <glm/geometric.hpp>
 
-const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const Features& features, Ray ray, HitInfo hitInfo) {
-    if (!features.enableShading) { return hitInfo.material.kd; }
+const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const Features& features,
+                               const Ray& ray, const HitInfo& hitInfo, const Material& material) {
+    return computeShading(lightPosition, lightColor, makeShadingPoint(ray, hitInfo, material, features));
+}
+
+const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const ShadingPoint& shadingPoint) {
+    if (!shadingPoint.enableShading) { return shadingPoint.diffuseColor; }
 
     // Diffuse parameters
-    glm::vec3 diffuseColor      = diffuseAlbedo(hitInfo, features);
-    glm::vec3 intersectionPos   = ray.origin + (ray.t * ray.direction);
-    glm::vec3 L                 = glm::normalize(lightPosition - intersectionPos);
-    float dotNL                 = glm::dot(hitInfo.normal, L);
+    glm::vec3 L                 = glm::normalize(lightPosition - shadingPoint.position);
+    float dotNL                 = glm::dot(shadingPoint.normal, L);
 
     // Early exit if light is behind point
     if (dotNL < 0.0f) { return glm::vec3(0.0f); }
 
     // Specular parameters
-    glm::vec3 V                 = glm::normalize(ray.origin - intersectionPos);
-    glm::vec3 R                 = glm::normalize(2.0f * dotNL * hitInfo.normal - L);
-    float cosTheta              = glm::dot(R, V);
+    glm::vec3 R                 = glm::normalize(2.0f * dotNL * shadingPoint.normal - L);
+    float cosTheta              = glm::dot(R, shadingPoint.viewDirection);
 
     // Shading terms
-    glm::vec3 diffuse   = lightColor    * diffuseColor         * dotNL;
-    glm::vec3 specular  = lightColor    * hitInfo.material.ks  * std::pow(cosTheta, hitInfo.material.shininess);
+    glm::vec3 diffuse   = lightColor    * shadingPoint.diffuseColor     * dotNL;
+    glm::vec3 specular  = lightColor    * shadingPoint.specularColor    * std::pow(cosTheta, shadingPoint.shininess);
     diffuse             = glm::any(glm::isnan(diffuse))     ? glm::vec3(0.0f) : diffuse;
     specular            = glm::any(glm::isnan(specular))    ? glm::vec3(0.0f) : specular;
 
     // Inverse square law and final return
-    float pointToLightDist = glm::distance(intersectionPos, lightPosition);
+    float pointToLightDist = glm::distance(shadingPoint.position, lightPosition);
     if (zeroWithinEpsilon(pointToLightDist)) { pointToLightDist = 1.0f; }
     return (diffuse + specular) / (pointToLightDist * pointToLightDist);
 }
@@ -39,4 +41,105 @@ const Ray computeReflectionRay(Ray ray, HitInfo hitInfo) {
     glm::vec3 reflectionVector  = 2.0f * glm::dot(normL, hitInfo.normal) * hitInfo.normal - normL;
     Ray reflectionRay {incidentPoint + (REFLECTION_EPSILON * reflectionVector), reflectionVector, std::numeric_limits<float>::max()};
     return reflectionRay;
-}
\ No newline at end of file
+}
+
+ShadingPoint makeShadingPoint(const Ray& ray, const HitInfo& hitInfo, const Material& material, const Features& features) {
+    const glm::vec3 intersectionPos = ray.origin + (ray.t * ray.direction);
+    return { .position          = intersectionPos,
+             .normal            = hitInfo.normal,
+             .viewDirection     = glm::normalize(ray.origin - intersectionPos),
+             .diffuseColor      = features.enableShading ? diffuseAlbedo(hitInfo, material, features) : material.kd,
+             .specularColor     = material.ks,
+             .shininess         = material.shininess,
+             .enableShading     = features.enableShading };
+}
+
+// Same arithmetic as computeShading, with the per-light branches turned into masks
+void computeShadingLengths(const ShadingPoint& shadingPoint, const ShadingBatch& batch, std::array<float, simd::LANES>& lengths) {
+    using namespace simd;
+    if (!shadingPoint.enableShading) {
+        lengths.fill(glm::length(shadingPoint.diffuseColor));
+        return;
+    }
+
+    const Float zero        = broadcast(0.0f);
+    const Float lightR      = load(batch.colorR.data());
+    const Float lightG      = load(batch.colorG.data());
+    const Float lightB      = load(batch.colorB.data());
+    const Float normalX     = broadcast(shadingPoint.normal.x);
+    const Float normalY     = broadcast(shadingPoint.normal.y);
+    const Float normalZ     = broadcast(shadingPoint.normal.z);
+
+    // Light direction and distance
+    const Float toLightX    = load(batch.positionX.data()) - broadcast(shadingPoint.position.x);
+    const Float toLightY    = load(batch.positionY.data()) - broadcast(shadingPoint.position.y);
+    const Float toLightZ    = load(batch.positionZ.data()) - broadcast(shadingPoint.position.z);
+    const Float distance    = sqrt(fmadd(toLightX, toLightX, fmadd(toLightY, toLightY, toLightZ * toLightZ)));
+    const Float lX          = toLightX / distance;
+    const Float lY          = toLightY / distance;
+    const Float lZ          = toLightZ / distance;
+    const Float dotNL       = fmadd(normalX, lX, fmadd(normalY, lY, normalZ * lZ));
+
+    // Specular lobe around the reflected light direction
+    const Float twoDotNL    = broadcast(2.0f) * dotNL;
+    const Float rX          = (twoDotNL * normalX) - lX;
+    const Float rY          = (twoDotNL * normalY) - lY;
+    const Float rZ          = (twoDotNL * normalZ) - lZ;
+    const Float rLength     = sqrt(fmadd(rX, rX, fmadd(rY, rY, rZ * rZ)));
+    const Float cosTheta    = fmadd(rX, broadcast(shadingPoint.viewDirection.x),
+                              fmadd(rY, broadcast(shadingPoint.viewDirection.y),
+                                    rZ * broadcast(shadingPoint.viewDirection.z))) / rLength;
+    const Float specularPow = pow(cosTheta, shadingPoint.shininess);
+
+    // Shading terms, each dropped entirely if any of its components is NaN
+    Float diffuseR          = lightR * broadcast(shadingPoint.diffuseColor.r) * dotNL;
+    Float diffuseG          = lightG * broadcast(shadingPoint.diffuseColor.g) * dotNL;
+    Float diffuseB          = lightB * broadcast(shadingPoint.diffuseColor.b) * dotNL;
+    Float specularR         = lightR * broadcast(shadingPoint.specularColor.r) * specularPow;
+    Float specularG         = lightG * broadcast(shadingPoint.specularColor.g) * specularPow;
+    Float specularB         = lightB * broadcast(shadingPoint.specularColor.b) * specularPow;
+    const Mask diffuseNaN   = isNaN(diffuseR) | isNaN(diffuseG) | isNaN(diffuseB);
+    const Mask specularNaN  = isNaN(specularR) | isNaN(specularG) | isNaN(specularB);
+    diffuseR                = select(diffuseNaN, zero, diffuseR);
+    diffuseG                = select(diffuseNaN, zero, diffuseG);
+    diffuseB                = select(diffuseNaN, zero, diffuseB);
+    specularR               = select(specularNaN, zero, specularR);
+    specularG               = select(specularNaN, zero, specularG);
+    specularB               = select(specularNaN, zero, specularB);
+
+    // Inverse square law, lights behind the point contribute nothing
+    const Float safeDistance    = select(abs(distance) < broadcast(ZERO_EPSILON), broadcast(1.0f), distance);
+    const Float distanceSq      = safeDistance * safeDistance;
+    const Float shadedR         = (diffuseR + specularR) / distanceSq;
+    const Float shadedG         = (diffuseG + specularG) / distanceSq;
+    const Float shadedB         = (diffuseB + specularB) / distanceSq;
+    const Float length          = sqrt(fmadd(shadedR, shadedR, fmadd(shadedG, shadedG, shadedB * shadedB)));
+    store(lengths.data(), select(dotNL < zero, zero, length));
+}
+
+void computeGeometricLengths(const ShadingPoint& shadingPoint, const ShadingBatch& batch, std::array<float, simd::LANES>& lengths) {
+    using namespace simd;
+    if (!shadingPoint.enableShading) {
+        lengths.fill(glm::length(shadingPoint.diffuseColor));
+        return;
+    }
+
+    // Albedo covers both lobes, so lights lit only through the specular lobe keep a non-zero target
+    const glm::vec3 albedo  = shadingPoint.diffuseColor + shadingPoint.specularColor;
+    const Float reflectedR  = load(batch.colorR.data()) * broadcast(albedo.r);
+    const Float reflectedG  = load(batch.colorG.data()) * broadcast(albedo.g);
+    const Float reflectedB  = load(batch.colorB.data()) * broadcast(albedo.b);
+
+    const Float toLightX    = load(batch.positionX.data()) - broadcast(shadingPoint.position.x);
+    const Float toLightY    = load(batch.positionY.data()) - broadcast(shadingPoint.position.y);
+    const Float toLightZ    = load(batch.positionZ.data()) - broadcast(shadingPoint.position.z);
+    const Float distance    = sqrt(fmadd(toLightX, toLightX, fmadd(toLightY, toLightY, toLightZ * toLightZ)));
+    const Float dotNL       = fmadd(broadcast(shadingPoint.normal.x), toLightX,
+                              fmadd(broadcast(shadingPoint.normal.y), toLightY,
+                                    broadcast(shadingPoint.normal.z) * toLightZ)) / distance;
+
+    const Float safeDistance    = select(abs(distance) < broadcast(ZERO_EPSILON), broadcast(1.0f), distance);
+    const Float reflected       = sqrt(fmadd(reflectedR, reflectedR, fmadd(reflectedG, reflectedG, reflectedB * reflectedB)));
+    const Float length          = (reflected * dotNL) / (safeDistance * safeDistance);
+    store(lengths.data(), select(dotNL > broadcast(0.0f), length, broadcast(0.0f))); // Also zeroes out NaNs of degenerate shading points
+}
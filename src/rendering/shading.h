@@ -2,11 +2,43 @@
 #include <framework/ray.h>
 
 #include <utils/common.h>
+#include <utils/simd.h>
+
+#include <array>
 
 constexpr float REFLECTION_EPSILON = 1E-3F;
 
 // Compute the shading at the intersection point using the Phong model.
-const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const Features& features, Ray ray, HitInfo hitInfo);
+const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const Features& features,
+                               const Ray& ray, const HitInfo& hitInfo, const Material& material);
+
+// Shading point quantities shared by every light shaded at it
+struct ShadingPoint {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 viewDirection;
+    glm::vec3 diffuseColor;
+    glm::vec3 specularColor;
+    float shininess;
+    bool enableShading;
+};
+
+// Same as above, for a shading point resolved ahead of time (e.g. from the G-buffer)
+const glm::vec3 computeShading(const glm::vec3& lightPosition, const glm::vec3& lightColor, const ShadingPoint& shadingPoint);
+
+// Light positions and colors in structure-of-arrays layout, one SIMD register's worth
+struct alignas(64) ShadingBatch {
+    std::array<float, simd::LANES> positionX, positionY, positionZ;
+    std::array<float, simd::LANES> colorR, colorG, colorB;
+};
+
+ShadingPoint makeShadingPoint(const Ray& ray, const HitInfo& hitInfo, const Material& material, const Features& features);
+
+// Length of computeShading for every light of the batch, all lanes at once
+void computeShadingLengths(const ShadingPoint& shadingPoint, const ShadingBatch& batch, std::array<float, simd::LANES>& lengths);
+
+// Cheap approximation of computeShadingLengths, zero only where the exact shading is zero too (see TargetFunction::Geometric)
+void computeGeometricLengths(const ShadingPoint& shadingPoint, const ShadingBatch& batch, std::array<float, simd::LANES>& lengths);
 
 // Given a ray and a normal (in hitInfo), compute the reflected ray in the specular direction (mirror direction).
 const Ray computeReflectionRay(Ray ray, HitInfo hitInfo);
\ No newline at end of file
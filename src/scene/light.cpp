@@ -7,93 +7,121 @@
 // Suppress warnings in third-party code.
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
 #include <cmath>
-#include <random>
-#include <vector>
+#include <span>
 
+// Samples a light from the scene's light buffer. Every type is a bilinear patch (with zero edges where the light has no
+// extent), so all lights share the same code path and consume two uniform values
+LightSample sampleLight(const Scene& scene, uint32_t lightIdx, Sampler& sampler) {
+    const float axOneFrac = sampler.next1D();
+    const float axTwoFrac = sampler.next1D();
+    return lightSampleAt(scene, lightIdx, glm::vec2(axOneFrac, axTwoFrac));
+}
 
-// samples a segment light source
-// you should fill in the vectors position and color with the sampled position and color
-void sampleSegmentLight(const SegmentLight& segmentLight, glm::vec3& position, glm::vec3& color) {
-    float segFrac   = linearMap(static_cast<float>(rand()), 0.0f, RAND_MAX, 0.0f, 1.0f);
-    position        = glm::mix(segmentLight.endpoint0, segmentLight.endpoint1, segFrac);
-    color           = glm::mix(segmentLight.color0, segmentLight.color1, segFrac);
+LightSample lightSampleAt(const Scene& scene, uint32_t lightIdx, const glm::vec2& coordinates) {
+    const LightBuffer& lights   = scene.lightBuffer;
+    LightSample sample;
+    sample.lightIdx             = lightIdx;
+    sample.position             = lights.origins[lightIdx] + (coordinates.x * lights.edges0[lightIdx]) + (coordinates.y * lights.edges1[lightIdx]);
+    const glm::vec3 linLerp01   = glm::mix(lights.colors0[lightIdx], lights.colors1[lightIdx], coordinates.x);
+    const glm::vec3 linLerp23   = glm::mix(lights.colors2[lightIdx], lights.colors3[lightIdx], coordinates.x);
+    sample.color                = glm::mix(linLerp01, linLerp23, coordinates.y);
+    return sample;
 }
 
-// samples a parallelogram light source
-// you should fill in the vectors position and color with the sampled position and color
-void sampleParallelogramLight(const ParallelogramLight& parallelogramLight, glm::vec3& position, glm::vec3& color) {
-    float axOneFrac = linearMap(static_cast<float>(rand()), 0.0f, RAND_MAX, 0.0f, 1.0f);
-    float axTwoFrac = linearMap(static_cast<float>(rand()), 0.0f, RAND_MAX, 0.0f, 1.0f);
-    position            = parallelogramLight.v0 + (axOneFrac * parallelogramLight.edge01) + (axTwoFrac * parallelogramLight.edge02);
-    glm::vec3 linLerp01 = glm::mix(parallelogramLight.color0, parallelogramLight.color1, axOneFrac);
-    glm::vec3 linLerp23 = glm::mix(parallelogramLight.color2, parallelogramLight.color3, axOneFrac);
-    color               = glm::mix(linLerp01, linLerp23, axTwoFrac);
+glm::vec2 lightSampleCoordinates(const Scene& scene, const LightSample& sample) {
+    const LightBuffer& lights   = scene.lightBuffer;
+    const glm::vec3& edge0      = lights.edges0[sample.lightIdx];
+    const glm::vec3& edge1      = lights.edges1[sample.lightIdx];
+    const glm::vec3 offset      = sample.position - lights.origins[sample.lightIdx];
+
+    // Solve offset = u * edge0 + v * edge1 in the least squares sense, through the Gram matrix of the edges
+    const float edge0Sq     = glm::dot(edge0, edge0);
+    const float edge1Sq     = glm::dot(edge1, edge1);
+    const float edgesDot    = glm::dot(edge0, edge1);
+    const float determinant = (edge0Sq * edge1Sq) - (edgesDot * edgesDot);
+    glm::vec2 coordinates(0.0f);
+    if (determinant > 0.0f) {
+        coordinates = glm::vec2((edge1Sq * glm::dot(offset, edge0)) - (edgesDot * glm::dot(offset, edge1)),
+                                (edge0Sq * glm::dot(offset, edge1)) - (edgesDot * glm::dot(offset, edge0))) / determinant;
+    } else if (edge0Sq > 0.0f) {
+        coordinates.x = glm::dot(offset, edge0) / edge0Sq; // Segments only extend along their first edge
+    }
+    return glm::clamp(coordinates, 0.0f, 1.0f);
 }
 
 // Given an intersection, computes the contribution from all light sources at the intersection point
 // in this method you should cycle the light sources and for each one compute their contribution
 // don't forget to check for visibility (shadows!)
-Reservoir genCanonicalSamples(const Scene& scene, const EmbreeInterface& embreeInterface, const Features& features, const RayHit& rayHit) {
+template <size_t Capacity>
+Reservoir<Capacity> genCanonicalSamples(const Scene& scene, const LightSampler& lightSampler, std::span<const PresampledLight> lightTile,
+                                        const Features& features, const GBuffer& gBuffer, size_t pixelIdx, Sampler& sampler, ResamplingScratch& scratch) {
     // Commit primary hit info to reservoir
-    Reservoir reservoir(features.numSamplesInReservoir);
-    reservoir.cameraRay = rayHit.ray;
-    reservoir.hitInfo   = rayHit.hit;
+    Reservoir<Capacity> reservoir(features.numSamplesInReservoir);
+    reservoir.pixelIdx          = static_cast<uint32_t>(pixelIdx);
+    reservoir.targetFunction    = features.candidateTarget;
     
     // No lights to sample, just return
-    if (scene.lights.size() == 0UL) { return reservoir; }
+    if (scene.lightBuffer.size() == 0UL) { return reservoir; }
 
-    // Uniform selection of light sources
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distr(0, scene.lights.size() - 1UL);
-
-    // Compute intersection point properties
-    glm::vec3 intersectionPosition  = reservoir.cameraRay.origin + (reservoir.cameraRay.t * reservoir.cameraRay.direction);
-    glm::vec3 diffuseColor          = diffuseAlbedo(reservoir.hitInfo, features);
+    // Shading point lights are selected for
+    const ShadingPoint shadingPoint = gBuffer.shadingPoint(pixelIdx);
 
     // Zero out cautionary one sample for zero division avoidance
-    for (size_t reservoirIdx = 0ULL; reservoirIdx < reservoir.outputSamples.size(); reservoirIdx++) {
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < reservoir.size(); reservoirIdx++) {
         reservoir.sampleNums[reservoirIdx] = 0ULL;
     }
     
-    // Obtain initial light samples
+    // Obtain initial light samples. A zero source PDF marks a candidate for which no light can contribute
+    const size_t numCandidates = features.initialLightSamples;
+    scratch.resize(numCandidates);
+    const std::span<LightSample> candidates = std::span(scratch.samples).first(numCandidates);
+    const std::span<float> lightPdfs        = std::span(scratch.sourcePdfs).first(numCandidates);
     for (uint32_t sampleIdx = 0U; sampleIdx < features.initialLightSamples; sampleIdx++) {
-        // Generate sample
-        LightSample sample;
-        const auto& light = scene.lights[distr(gen)];
-        if (std::holds_alternative<PointLight>(light)) {
-            const PointLight pointLight = std::get<PointLight>(light);
-            sample.position             = pointLight.position;
-            sample.color                = pointLight.color;
-        } else if (std::holds_alternative<SegmentLight>(light)) {
-            const SegmentLight segmentLight = std::get<SegmentLight>(light);
-            sampleSegmentLight(segmentLight, sample.position, sample.color);
-        } else if (std::holds_alternative<ParallelogramLight>(light)) {
-            const ParallelogramLight parallelogramLight = std::get<ParallelogramLight>(light);
-            sampleParallelogramLight(parallelogramLight, sample.position, sample.color);
+        // Generate sample, light selection and position on the light are dimensions of the same sequence point
+        sampler.startSample(sampleIdx);
+        if (!lightTile.empty()) {
+            // Uniform pick among samples drawn from the source distribution, so the candidate follows that same distribution
+            const PresampledLight& presampled = lightTile[sampler.nextIndex(static_cast<uint32_t>(lightTile.size()))];
+            candidates[sampleIdx]   = presampled.sample;
+            lightPdfs[sampleIdx]    = presampled.pdf;
+        } else {
+            const uint32_t lightIdx = lightSampler.sample(sampler, shadingPoint.position, shadingPoint.normal, lightPdfs[sampleIdx]);
+            candidates[sampleIdx]   = lightPdfs[sampleIdx] > 0.0f ? sampleLight(scene, lightIdx, sampler) : LightSample {};
         }
-
-        // Update reservoir
-        float sampleWeight = targetPDF(sample, reservoir.cameraRay, reservoir.hitInfo, features) / (1.0f / static_cast<float>(scene.lights.size())); // We uniformly sample all lights, so distribution PDF is uniform
-        reservoir.update(sample, sampleWeight); 
     }
 
-    // Set output weight and do optional visibility check
-    for (size_t reservoirIdx = 0ULL; reservoirIdx < reservoir.outputSamples.size(); reservoirIdx++)  {
-        if (features.initialSamplesVisibilityCheck && !testVisibilityLightSample(reservoir.outputSamples[reservoirIdx].lightSample.position, embreeInterface, features, reservoir.cameraRay, reservoir.hitInfo)) {
-            reservoir.outputSamples[reservoirIdx].outputWeight = 0.0f;
-        } else {
-            float pdfValue = targetPDF(reservoir.outputSamples[reservoirIdx].lightSample, reservoir.cameraRay, reservoir.hitInfo, features);
-            if (pdfValue == 0.0f)   { reservoir.outputSamples[reservoirIdx].outputWeight  = 0.0f; }
-            else                    { reservoir.outputSamples[reservoirIdx].outputWeight  = (1.0f / pdfValue) * 
-                                                                                            (1.0f / reservoir.sampleNums[reservoirIdx]) *
-                                                                                            reservoir.wSums[reservoirIdx]; }
-        }
+    // Evaluate the target function of all candidates at once. The candidate target may be cheaper than the exact one used by
+    // later resampling, the output weights below are then computed with that same cheap target so they stay unbiased
+    const std::span<float> pdfValues = std::span(scratch.targetPdfs).first(numCandidates);
+    targetPDFs(std::span<const LightSample>(candidates), shadingPoint, pdfValues, reservoir.targetFunction);
+
+    // Update reservoir with all candidates at once. Candidates without a light still count
+    const std::span<float> sampleWeights = std::span(scratch.weights).first(numCandidates);
+    std::transform(pdfValues.begin(), pdfValues.end(), lightPdfs.begin(), sampleWeights.begin(), [](float pdfValue, float lightPdf) {
+        return lightPdf > 0.0f ? pdfValue / lightPdf : 0.0f;
+    });
+    reservoir.updateBatch(candidates, sampleWeights, pdfValues, sampler, std::span(scratch.assignments).first(numCandidates),
+                          std::span(scratch.prefixSums).first(numCandidates), std::span(scratch.groupedIdxs).first(numCandidates));
+
+    // Set output weight (the optional visibility check is batched by the caller)
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < reservoir.size(); reservoirIdx++)  {
+        float pdfValue = reservoir.outputSamples[reservoirIdx].targetPdf;
+        if (pdfValue == 0.0f)   { reservoir.outputSamples[reservoirIdx].outputWeight  = 0.0f; }
+        else                    { reservoir.outputSamples[reservoirIdx].outputWeight  = (1.0f / pdfValue) * 
+                                                                                        (1.0f / reservoir.sampleNums[reservoirIdx]) *
+                                                                                        reservoir.wSums[reservoirIdx]; }
     }
     
     // Final return
     return reservoir;
 }
+
+#define INSTANTIATE_GEN_CANONICAL_SAMPLES(CAPACITY) \
+    template Reservoir<CAPACITY> genCanonicalSamples(const Scene&, const LightSampler&, std::span<const PresampledLight>, const Features&, const GBuffer&, size_t, Sampler&, ResamplingScratch&);
+FOR_EACH_RESERVOIR_CAPACITY(INSTANTIATE_GEN_CANONICAL_SAMPLES)
+#undef INSTANTIATE_GEN_CANONICAL_SAMPLES
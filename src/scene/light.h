@@ -1,15 +1,25 @@
 #pragma once
 #include <ray_tracing/embree_interface.h>
+#include <rendering/g_buffer.h>
 #include <rendering/reservoir.h>
 #include <rendering/shading.h>
+#include <scene/light_sampler.h>
+#include <scene/light_tiles.h>
 #include <scene/scene.h>
 #include <ui/draw.h>
 #include <utils/config.h>
+#include <utils/sampler.h>
 
 
-// Light samplers
-void sampleSegmentLight(const SegmentLight& segmentLight, glm::vec3& position, glm::vec3& color);
-void sampleParallelogramLight(const ParallelogramLight& parallelogramLight, glm::vec3& position, glm::vec3& color);
+// Light sampler
+LightSample sampleLight(const Scene& scene, uint32_t lightIdx, Sampler& sampler);
+
+// Sample at the given coordinates along the edges of a light, and the inverse mapping of a sample on its light to those coordinates
+LightSample lightSampleAt(const Scene& scene, uint32_t lightIdx, const glm::vec2& coordinates);
+glm::vec2 lightSampleCoordinates(const Scene& scene, const LightSample& sample);
 
 // ReSTIR per-pixel canonical samples
-Reservoir genCanonicalSamples(const Scene& scene, const EmbreeInterface& embreeInterface, const Features& features, const RayHit& rayHit);
+// Candidates are drawn from the light tile if it is not empty, and from the light sampler otherwise, and staged in the given scratch
+template <size_t Capacity>
+Reservoir<Capacity> genCanonicalSamples(const Scene& scene, const LightSampler& lightSampler, std::span<const PresampledLight> lightTile,
+                                        const Features& features, const GBuffer& gBuffer, size_t pixelIdx, Sampler& sampler, ResamplingScratch& scratch);
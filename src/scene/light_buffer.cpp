@@ -0,0 +1,60 @@
+#include "light_buffer.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+
+
+static float averageComponent(const glm::vec3& color) { return (color.r + color.g + color.b) / 3.0f; }
+
+// Degenerate segments and parallelograms are sampled exactly like point lights, so they are weighted like one
+static float lightMeasure(float measure) { return measure > 0.0f ? measure : 1.0f; }
+
+float lightPower(const LightVariant& light) {
+    if (std::holds_alternative<PointLight>(light)) {
+        const PointLight& pointLight = std::get<PointLight>(light);
+        return averageComponent(pointLight.color);
+    } else if (std::holds_alternative<SegmentLight>(light)) {
+        const SegmentLight& segmentLight    = std::get<SegmentLight>(light);
+        const float length                  = glm::length(segmentLight.endpoint1 - segmentLight.endpoint0);
+        return averageComponent(0.5f * (segmentLight.color0 + segmentLight.color1)) * lightMeasure(length);
+    } else {
+        const ParallelogramLight& parallelogramLight    = std::get<ParallelogramLight>(light);
+        const float area                                = glm::length(glm::cross(parallelogramLight.edge01, parallelogramLight.edge02));
+        const glm::vec3 averageColor                    = 0.25f * (parallelogramLight.color0 + parallelogramLight.color1 + parallelogramLight.color2 + parallelogramLight.color3);
+        return averageComponent(averageColor) * lightMeasure(area);
+    }
+}
+
+LightBuffer compileLights(const std::vector<LightVariant>& lights) {
+    LightBuffer buffer;
+    const auto push = [&](const glm::vec3& origin, const glm::vec3& edge0, const glm::vec3& edge1,
+                          const glm::vec3& color0, const glm::vec3& color1, const glm::vec3& color2, const glm::vec3& color3) {
+        buffer.origins.push_back(origin);
+        buffer.edges0.push_back(edge0);
+        buffer.edges1.push_back(edge1);
+        buffer.colors0.push_back(color0);
+        buffer.colors1.push_back(color1);
+        buffer.colors2.push_back(color2);
+        buffer.colors3.push_back(color3);
+    };
+
+    for (const LightVariant& light : lights) {
+        if (std::holds_alternative<PointLight>(light)) {
+            const PointLight& pointLight = std::get<PointLight>(light);
+            push(pointLight.position, glm::vec3(0.0f), glm::vec3(0.0f),
+                 pointLight.color, pointLight.color, pointLight.color, pointLight.color);
+        } else if (std::holds_alternative<SegmentLight>(light)) {
+            const SegmentLight& segmentLight = std::get<SegmentLight>(light);
+            push(segmentLight.endpoint0, segmentLight.endpoint1 - segmentLight.endpoint0, glm::vec3(0.0f),
+                 segmentLight.color0, segmentLight.color1, segmentLight.color0, segmentLight.color1);
+        } else {
+            const ParallelogramLight& parallelogramLight = std::get<ParallelogramLight>(light);
+            push(parallelogramLight.v0, parallelogramLight.edge01, parallelogramLight.edge02,
+                 parallelogramLight.color0, parallelogramLight.color1, parallelogramLight.color2, parallelogramLight.color3);
+        }
+        buffer.powers.push_back(lightPower(light));
+    }
+    return buffer;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef _LIGHT_BUFFER_H_
+#define _LIGHT_BUFFER_H_
+
+#include <utils/common.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+using LightVariant = std::variant<PointLight, SegmentLight, ParallelogramLight>;
+
+/**
+ * Structure-of-arrays form of a scene's lights, compiled from the editable light variants. Every light is stored as a
+ * (possibly degenerate) parallelogram with bilinearly interpolated corner colors: segments have a zero second edge and
+ * points have zero edges. Sampling a light is thus the same branch-free computation for every type
+*/
+struct LightBuffer {
+    std::vector<glm::vec3> origins;                         // Point position, first segment endpoint or parallelogram v0
+    std::vector<glm::vec3> edges0, edges1;                  // Edges spanned from the origin, zero where the light has no extent
+    std::vector<glm::vec3> colors0, colors1, colors2, colors3; // Colors at origin, origin+edge0, origin+edge1 and origin+edge0+edge1
+    std::vector<float> powers;                              // See lightPower
+
+    size_t size() const { return origins.size(); }
+};
+
+// Emitted power of a light, its (average) color weighted by its length or area
+float lightPower(const LightVariant& light);
+
+// Compile the given lights into a light buffer
+LightBuffer compileLights(const std::vector<LightVariant>& lights);
+
+#endif // _LIGHT_BUFFER_H_
@@ -0,0 +1,198 @@
+#include "light_bvh.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+
+constexpr float MIN_IMPORTANCE_DISTANCE_SQ = 1E-4F; // Keeps the inverse square falloff of lights at the shading point finite
+
+
+static float safeAcos(float cosine) { return std::acos(std::clamp(cosine, -1.0f, 1.0f)); }
+
+// Smallest cone containing both cones (Conty Estevez and Kulla, algorithm 1)
+static EmissionCone coneUnion(EmissionCone a, EmissionCone b) {
+    if (b.thetaO > a.thetaO) { std::swap(a, b); }
+    const float thetaD = safeAcos(glm::dot(a.axis, b.axis));
+    const float thetaE = std::max(a.thetaE, b.thetaE);
+    if (std::min(thetaD + b.thetaO, glm::pi<float>()) <= a.thetaO) { return { a.axis, a.thetaO, thetaE }; }
+
+    const float thetaO = 0.5f * (a.thetaO + thetaD + b.thetaO);
+    const glm::vec3 orthogonal = b.axis - (glm::dot(a.axis, b.axis) * a.axis);
+    if (thetaO >= glm::pi<float>() || glm::length(orthogonal) < 1E-6F) { return { a.axis, glm::pi<float>(), thetaE }; }
+
+    // Rotate a's axis towards b's by the growth of the spread
+    const float thetaR = thetaO - a.thetaO;
+    const glm::vec3 axis = (std::cos(thetaR) * a.axis) + (std::sin(thetaR) * glm::normalize(orthogonal));
+    return { glm::normalize(axis), thetaO, thetaE };
+}
+
+// Leaf bounding a single light. Shading does not attenuate lights by their own orientation, so every light type emits in all directions
+static LightBvhNode lightLeaf(const LightBuffer& lights, uint32_t lightIdx) {
+    const glm::vec3& v0     = lights.origins[lightIdx];
+    const glm::vec3 v1      = v0 + lights.edges0[lightIdx];
+    const glm::vec3 v2      = v0 + lights.edges1[lightIdx];
+    const glm::vec3 v3      = v1 + lights.edges1[lightIdx];
+
+    LightBvhNode leaf;
+    leaf.boundsMin          = glm::min(glm::min(v0, v1), glm::min(v2, v3));
+    leaf.boundsMax          = glm::max(glm::max(v0, v1), glm::max(v2, v3));
+    leaf.cone               = { glm::vec3(0.0f, 0.0f, 1.0f), glm::pi<float>(), glm::half_pi<float>() };
+    leaf.power              = lights.powers[lightIdx];
+    leaf.childOrLightIdx    = lightIdx;
+    leaf.isLeaf             = true;
+    return leaf;
+}
+
+LightBvh::LightBvh(const Scene& scene, bool receiverCosine) : m_receiverCosine(receiverCosine) {
+    const LightBuffer& lights = scene.lightBuffer;
+    if (lights.size() == 0ULL) { return; }
+
+    std::vector<LightBvhNode> lightLeaves;
+    lightLeaves.reserve(lights.size());
+    for (uint32_t lightIdx = 0U; lightIdx < lights.size(); lightIdx++) { lightLeaves.push_back(lightLeaf(lights, lightIdx)); }
+
+    std::vector<uint32_t> lightIndices(lights.size());
+    std::iota(lightIndices.begin(), lightIndices.end(), 0U);
+    m_lightPaths.resize(lights.size());
+    m_nodes.reserve((2ULL * lights.size()) - 1ULL);
+    m_nodes.emplace_back();
+    build(lightLeaves, lightIndices, 0ULL, lightIndices.size(), 0U, 0ULL, 0U);
+}
+
+void LightBvh::build(const std::vector<LightBvhNode>& lightLeaves, std::vector<uint32_t>& lightIndices, size_t begin, size_t end,
+                     uint32_t nodeIdx, uint64_t path, uint32_t depth) {
+    if (end - begin == 1ULL) {
+        m_nodes[nodeIdx]                    = lightLeaves[lightIndices[begin]];
+        m_lightPaths[lightIndices[begin]]   = path;
+        return;
+    }
+    if (depth >= 64U) { throw std::runtime_error("Light BVH exceeds the maximum supported depth"); }
+
+    // Median split along the largest extent of the light centroids
+    glm::vec3 centroidMin(std::numeric_limits<float>::max()), centroidMax(std::numeric_limits<float>::lowest());
+    for (size_t idx = begin; idx < end; idx++) {
+        const LightBvhNode& leaf    = lightLeaves[lightIndices[idx]];
+        const glm::vec3 centroid    = 0.5f * (leaf.boundsMin + leaf.boundsMax);
+        centroidMin                 = glm::min(centroidMin, centroid);
+        centroidMax                 = glm::max(centroidMax, centroid);
+    }
+    const glm::vec3 extent  = centroidMax - centroidMin;
+    const int axis          = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    const size_t middle     = begin + ((end - begin) / 2ULL);
+    std::nth_element(lightIndices.begin() + static_cast<std::ptrdiff_t>(begin), lightIndices.begin() + static_cast<std::ptrdiff_t>(middle),
+                     lightIndices.begin() + static_cast<std::ptrdiff_t>(end), [&](uint32_t lhs, uint32_t rhs) {
+        return (lightLeaves[lhs].boundsMin[axis] + lightLeaves[lhs].boundsMax[axis]) < (lightLeaves[rhs].boundsMin[axis] + lightLeaves[rhs].boundsMax[axis]);
+    });
+
+    // Children are stored next to each other, the right one directly after the left
+    const uint32_t leftIdx = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes.emplace_back();
+    build(lightLeaves, lightIndices, begin, middle, leftIdx, path, depth + 1U);
+    build(lightLeaves, lightIndices, middle, end, leftIdx + 1U, path | (1ULL << depth), depth + 1U);
+
+    const LightBvhNode& left    = m_nodes[leftIdx];
+    const LightBvhNode& right   = m_nodes[leftIdx + 1U];
+    LightBvhNode& node          = m_nodes[nodeIdx];
+    node.boundsMin              = glm::min(left.boundsMin, right.boundsMin);
+    node.boundsMax              = glm::max(left.boundsMax, right.boundsMax);
+    node.cone                   = coneUnion(left.cone, right.cone);
+    node.power                  = left.power + right.power;
+    node.childOrLightIdx        = leftIdx;
+    node.isLeaf                 = false;
+}
+
+float LightBvh::importance(const LightBvhNode& node, const glm::vec3& position, const glm::vec3& normal) const {
+    if (node.power <= 0.0f) { return 0.0f; }
+
+    const glm::vec3 center  = 0.5f * (node.boundsMin + node.boundsMax);
+    const float radius      = 0.5f * glm::length(node.boundsMax - node.boundsMin);
+    const glm::vec3 toNode  = center - position;
+    const float distanceSq  = glm::dot(toNode, toNode);
+    if (!std::isfinite(distanceSq)) { return 0.0f; } // Shading point at infinity (primary ray missed)
+
+    // Angle subtended by the node's bounding sphere, every direction if the shading point is inside it
+    const float distance        = std::sqrt(distanceSq);
+    const bool inside           = distance <= radius;
+    const float thetaU          = inside ? glm::pi<float>() : std::asin(radius / distance);
+    const glm::vec3 direction   = inside ? glm::vec3(0.0f) : toNode / distance;
+
+    // Emitter side: smallest angle between the emission cone and any direction towards the shading point
+    float cosEmitter = 1.0f;
+    if (!inside && node.cone.thetaO < glm::pi<float>()) {
+        const float theta       = safeAcos(glm::dot(node.cone.axis, -direction));
+        const float thetaPrime  = std::max(0.0f, theta - node.cone.thetaO - thetaU);
+        if (thetaPrime >= node.cone.thetaE) { return 0.0f; }
+        cosEmitter              = std::cos(thetaPrime);
+    }
+
+    // Receiver side: smallest angle between the normal and any direction towards the node
+    float cosReceiver = 1.0f;
+    if (m_receiverCosine && !inside) {
+        const float thetaI      = safeAcos(glm::dot(normal, direction));
+        const float thetaPrime  = std::max(0.0f, thetaI - thetaU);
+        if (thetaPrime >= glm::half_pi<float>()) { return 0.0f; }
+        cosReceiver             = std::cos(thetaPrime);
+    }
+
+    return node.power * cosEmitter * cosReceiver / std::max({ distanceSq, radius * radius, MIN_IMPORTANCE_DISTANCE_SQ });
+}
+
+uint32_t LightBvh::sample(Sampler& sampler, const glm::vec3& position, const glm::vec3& normal, float& pdf) const {
+    pdf = 0.0f;
+    if (m_nodes.empty()) { return 0U; }
+
+    // Descend proportionally to child importance, rescaling the single uniform value at every level
+    float uniform       = sampler.next1D();
+    float pathPdf       = 1.0f;
+    uint32_t nodeIdx    = 0U;
+    while (!m_nodes[nodeIdx].isLeaf) {
+        const uint32_t leftIdx      = m_nodes[nodeIdx].childOrLightIdx;
+        const float leftImportance  = importance(m_nodes[leftIdx], position, normal);
+        const float rightImportance = importance(m_nodes[leftIdx + 1U], position, normal);
+        const float totalImportance = leftImportance + rightImportance;
+        if (totalImportance <= 0.0f) { return 0U; } // No light below this node can contribute
+
+        const float leftProbability = leftImportance / totalImportance;
+        if (uniform < leftProbability) {
+            uniform     = std::min(uniform / leftProbability, 0x1.fffffep-1f);
+            pathPdf     *= leftProbability;
+            nodeIdx     = leftIdx;
+        } else {
+            uniform     = std::min((uniform - leftProbability) / (1.0f - leftProbability), 0x1.fffffep-1f);
+            pathPdf     *= 1.0f - leftProbability;
+            nodeIdx     = leftIdx + 1U;
+        }
+    }
+    pdf = pathPdf;
+    return m_nodes[nodeIdx].childOrLightIdx;
+}
+
+float LightBvh::pdf(uint32_t lightIdx, const glm::vec3& position, const glm::vec3& normal) const {
+    // Retrace the light's path from the root, accumulating the probability of every child taken
+    const uint64_t path = m_lightPaths[lightIdx];
+    float pathPdf       = 1.0f;
+    uint32_t nodeIdx    = 0U;
+    for (uint32_t depth = 0U; !m_nodes[nodeIdx].isLeaf; depth++) {
+        const uint32_t leftIdx      = m_nodes[nodeIdx].childOrLightIdx;
+        const float leftImportance  = importance(m_nodes[leftIdx], position, normal);
+        const float rightImportance = importance(m_nodes[leftIdx + 1U], position, normal);
+        const float totalImportance = leftImportance + rightImportance;
+        if (totalImportance <= 0.0f) { return 0.0f; }
+
+        const bool right            = (path >> depth) & 1ULL;
+        const float leftProbability = leftImportance / totalImportance;
+        pathPdf                     *= right ? 1.0f - leftProbability : leftProbability; // Same arithmetic as sample()
+        nodeIdx                     = leftIdx + (right ? 1U : 0U);
+    }
+    return pathPdf;
+}
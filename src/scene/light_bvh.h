@@ -0,0 +1,73 @@
+#pragma once
+#ifndef _LIGHT_BVH_H_
+#define _LIGHT_BVH_H_
+
+#include <scene/scene.h>
+#include <utils/sampler.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <vector>
+
+// Bound on the directions in which a set of lights emits: all emission lies within thetaO of the axis, and falls off to zero over a further thetaE
+struct EmissionCone {
+    glm::vec3 axis  = { 0.0f, 0.0f, 1.0f };
+    float thetaO    = 0.0f;
+    float thetaE    = 0.0f;
+};
+
+struct LightBvhNode {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    EmissionCone cone;
+    float power;
+    uint32_t childOrLightIdx;   // Index of the left child (the right child follows it) for inner nodes, index into Scene::lightBuffer for leaves
+    bool isLeaf;
+};
+
+/**
+ * Bounding volume hierarchy over the lights of a scene, with one light per leaf (Conty Estevez and Kulla, "Importance
+ * Sampling of Many Lights with Adaptive Tree Splitting", 2018). Every node bounds the positions, emission directions
+ * and total power of its lights. A light is sampled by descending from the root and picking each child proportionally
+ * to a conservative estimate of its importance to the shading point, so the PDF of a light is the product of the
+ * child probabilities along its path
+*/
+class LightBvh {
+public:
+    /**
+     * @param scene Scene whose lights are bounded
+     * @param receiverCosine Clusters entirely below the shading point's horizon get no importance. Only valid if shading
+     *                       zeroes out such lights, i.e. shading is enabled
+    */
+    LightBvh(const Scene& scene, bool receiverCosine);
+
+    /**
+     * Select a light by stochastic traversal
+     *
+     * @param sampler Random number source, consumes a single uniform value
+     * @param position Position of the shading point
+     * @param normal Normal of the shading point
+     * @param pdf Probability with which the returned light was selected. Zero if no light can contribute to the shading point
+     *
+     * @return Index of the selected light in Scene::lightBuffer
+    */
+    uint32_t sample(Sampler& sampler, const glm::vec3& position, const glm::vec3& normal, float& pdf) const;
+
+    // Probability with which the given light is selected for the given shading point
+    float pdf(uint32_t lightIdx, const glm::vec3& position, const glm::vec3& normal) const;
+
+private:
+    std::vector<LightBvhNode> m_nodes;
+    std::vector<uint64_t> m_lightPaths; // Per light, the child taken at each level from the root (bit set means right)
+    bool m_receiverCosine;
+
+    void build(const std::vector<LightBvhNode>& lightLeaves, std::vector<uint32_t>& lightIndices, size_t begin, size_t end,
+               uint32_t nodeIdx, uint64_t path, uint32_t depth);
+    float importance(const LightBvhNode& node, const glm::vec3& position, const glm::vec3& normal) const;
+};
+
+#endif // _LIGHT_BVH_H_
@@ -0,0 +1,67 @@
+#include "light_sampler.h"
+
+#include <algorithm>
+
+LightSampler::LightSampler(const Scene& scene, const Features& features) : m_numLights(scene.lightBuffer.size()) {
+    const size_t numLights = scene.lightBuffer.size();
+    if (numLights == 0ULL) { return; }
+    if (features.lightSelection == LightSelectionStrategy::BVH) {
+        m_bvh.emplace(scene, features.enableShading); // Without shading, lights behind the shading point still contribute
+        return;
+    }
+
+    // Selection weights, falling back to uniform selection when requested or when no light emits anything
+    std::vector<float> weights(numLights, 1.0f);
+    if (features.lightSelection == LightSelectionStrategy::Power) {
+        std::transform(scene.lightBuffer.powers.begin(), scene.lightBuffer.powers.end(), weights.begin(), [](float power) { return std::max(power, 0.0f); });
+    }
+    float weightSum = 0.0f;
+    for (float weight : weights) { weightSum += weight; }
+    if (weightSum <= 0.0f) {
+        std::fill(weights.begin(), weights.end(), 1.0f);
+        weightSum = static_cast<float>(numLights);
+    }
+    m_pdfs.resize(numLights);
+    for (size_t lightIdx = 0ULL; lightIdx < numLights; lightIdx++) { m_pdfs[lightIdx] = weights[lightIdx] / weightSum; }
+
+    // Vose's alias method. Bins are filled to an average of one by pairing an underfull bin with an overfull one
+    m_keepProbabilities.resize(numLights);
+    m_aliases.resize(numLights);
+    std::vector<float> scaled(numLights);
+    std::vector<uint32_t> small, large;
+    small.reserve(numLights);
+    large.reserve(numLights);
+    for (uint32_t lightIdx = 0U; lightIdx < numLights; lightIdx++) {
+        scaled[lightIdx] = m_pdfs[lightIdx] * static_cast<float>(numLights);
+        if (scaled[lightIdx] < 1.0f)    { small.push_back(lightIdx); }
+        else                            { large.push_back(lightIdx); }
+    }
+    while (!small.empty() && !large.empty()) {
+        const uint32_t underfull    = small.back(); small.pop_back();
+        const uint32_t overfull     = large.back(); large.pop_back();
+        m_keepProbabilities[underfull]  = scaled[underfull];
+        m_aliases[underfull]            = overfull;
+        scaled[overfull]                = (scaled[overfull] + scaled[underfull]) - 1.0f;
+        if (scaled[overfull] < 1.0f)    { small.push_back(overfull); }
+        else                            { large.push_back(overfull); }
+    }
+
+    // Whatever remains is full up to floating point error
+    for (uint32_t lightIdx : large) { m_keepProbabilities[lightIdx] = 1.0f; m_aliases[lightIdx] = lightIdx; }
+    for (uint32_t lightIdx : small) { m_keepProbabilities[lightIdx] = 1.0f; m_aliases[lightIdx] = lightIdx; }
+}
+
+uint32_t LightSampler::sample(Sampler& sampler, const glm::vec3& position, const glm::vec3& normal, float& pdf) const {
+    if (m_bvh) { return m_bvh->sample(sampler, position, normal, pdf); }
+
+    // A single uniform value picks the bin (integer part) and decides between the bin's light and its alias (fractional part)
+    const float scaled      = sampler.next1D() * static_cast<float>(m_pdfs.size());
+    const uint32_t bin      = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(m_pdfs.size() - 1ULL));
+    const uint32_t lightIdx = (scaled - static_cast<float>(bin)) < m_keepProbabilities[bin] ? bin : m_aliases[bin];
+    pdf                     = m_pdfs[lightIdx];
+    return lightIdx;
+}
+
+float LightSampler::pdf(uint32_t lightIdx, const glm::vec3& position, const glm::vec3& normal) const {
+    return m_bvh ? m_bvh->pdf(lightIdx, position, normal) : m_pdfs[lightIdx];
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef _LIGHT_SAMPLER_H_
+#define _LIGHT_SAMPLER_H_
+
+#include <scene/light_bvh.h>
+#include <scene/scene.h>
+#include <utils/common.h>
+#include <utils/sampler.h>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+/**
+ * Source distribution over the lights of a scene. Lights are picked uniformly, proportionally to their power (in constant
+ * time through a Vose alias table), or by traversing a light BVH, which adapts the distribution to the shading point.
+ * Built from a snapshot of the scene's light buffer at the start of a render
+*/
+class LightSampler {
+public:
+    LightSampler(const Scene& scene, const Features& features);
+
+    /**
+     * Select a light
+     *
+     * @param sampler Random number source, consumes a single uniform value
+     * @param position Position of the shading point the light is selected for
+     * @param normal Normal of the shading point the light is selected for
+     * @param pdf Probability with which the returned light was selected. Zero if no light can contribute to the shading point
+     *
+     * @return Index of the selected light in Scene::lightBuffer
+    */
+    uint32_t sample(Sampler& sampler, const glm::vec3& position, const glm::vec3& normal, float& pdf) const;
+
+    // Probability with which the given light is selected for the given shading point
+    float pdf(uint32_t lightIdx, const glm::vec3& position, const glm::vec3& normal) const;
+
+    // Whether the selection distribution changes with the shading point
+    bool shadingPointDependent() const { return m_bvh.has_value(); }
+
+    size_t size() const { return m_numLights; }
+
+private:
+    size_t m_numLights = 0ULL;
+    std::optional<LightBvh> m_bvh;
+
+    // Vose alias table. Bin i keeps light i with probability m_keepProbabilities[i], otherwise it yields m_aliases[i]
+    std::vector<float> m_keepProbabilities;
+    std::vector<uint32_t> m_aliases;
+    std::vector<float> m_pdfs;
+};
+
+#endif // _LIGHT_SAMPLER_H_
@@ -0,0 +1,36 @@
+#include "light_tiles.h"
+
+#include <scene/light.h>
+
+#ifdef NDEBUG
+#include <omp.h>
+#endif
+
+
+LightTiles::LightTiles(const Scene& scene, const LightSampler& lightSampler, const Features& features, uint32_t frameIdx, uint32_t pass)
+    : m_samples((scene.lightBuffer.size() == 0ULL) ? 0ULL : NUM_TILES * TILE_SIZE)
+    , m_frameIdx(frameIdx)
+    , m_pass(pass) {
+    if (scene.lightBuffer.size() == 0ULL) { return; }
+
+    // Every tile holds an independent set of samples from the source distribution
+    #ifdef NDEBUG
+    #pragma omp parallel for schedule(static)
+    #endif
+    for (int tileIdx = 0; tileIdx < static_cast<int>(NUM_TILES); tileIdx++) {
+        Sampler sampler(glm::ivec2(tileIdx, 0), frameIdx, SampleStream::LightPresampling, pass, features.sampleSequence);
+        for (uint32_t sampleIdx = 0U; sampleIdx < TILE_SIZE; sampleIdx++) {
+            sampler.startSample(sampleIdx);
+            PresampledLight& presampled = m_samples[(static_cast<size_t>(tileIdx) * TILE_SIZE) + sampleIdx];
+            const uint32_t lightIdx     = lightSampler.sample(sampler, glm::vec3(0.0f), glm::vec3(0.0f), presampled.pdf); // Shading point is ignored by shading-point-independent samplers
+            presampled.sample           = sampleLight(scene, lightIdx, sampler);
+        }
+    }
+}
+
+std::span<const PresampledLight> LightTiles::tileForPixel(const glm::ivec2& pixel) const {
+    if (m_samples.empty()) { return {}; }
+    Sampler sampler(pixel / static_cast<int32_t>(SCREEN_BLOCK_SIZE), m_frameIdx, SampleStream::LightTileSelection, m_pass);
+    const uint32_t tileIdx = sampler.nextIndex(NUM_TILES);
+    return std::span<const PresampledLight>(m_samples).subspan(tileIdx * TILE_SIZE, TILE_SIZE);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef _LIGHT_TILES_H_
+#define _LIGHT_TILES_H_
+
+#include <rendering/reservoir.h>
+#include <scene/light_sampler.h>
+#include <scene/scene.h>
+#include <utils/sampler.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Light sample drawn ahead of time, together with the source PDF it was drawn with
+struct PresampledLight {
+    LightSample sample;
+    float pdf;
+};
+
+/**
+ * Per-frame light presampling (as in RTXDI). A few thousand samples are drawn from the light sampler into small
+ * contiguous tiles, and all pixels of a screen block draw their candidates from the same randomly chosen tile.
+ * Picking uniformly from a tile yields samples from the source distribution, so candidate weights are unchanged,
+ * while the per-pixel loop only touches a cache-resident tile instead of the scene's lights.
+ * Only valid for light samplers which do not depend on the shading point
+*/
+class LightTiles {
+public:
+    static constexpr uint32_t NUM_TILES         = 16U;
+    static constexpr uint32_t TILE_SIZE         = 256U;
+    static constexpr uint32_t SCREEN_BLOCK_SIZE = 16U;  // Side length in pixels of the screen blocks sharing a tile
+
+    /**
+     * @param scene Scene whose lights are sampled
+     * @param lightSampler Source distribution of the samples
+     * @param features Features configuration
+     * @param frameIdx Index of the frame being rendered
+     * @param pass Repetition of candidate generation within the frame (e.g. MIS iteration)
+    */
+    LightTiles(const Scene& scene, const LightSampler& lightSampler, const Features& features, uint32_t frameIdx, uint32_t pass);
+
+    // Tile the candidates of the given pixel are drawn from
+    std::span<const PresampledLight> tileForPixel(const glm::ivec2& pixel) const;
+
+private:
+    std::vector<PresampledLight> m_samples; // All tiles back to back
+    uint32_t m_frameIdx;
+    uint32_t m_pass;
+};
+
+#endif // _LIGHT_TILES_H_
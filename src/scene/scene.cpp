@@ -1,4 +1,11 @@
 #include "scene.h"
+#include "scene_cache.h"
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/matrix_transform.hpp>
+DISABLE_WARNINGS_POP()
+
 #include <cmath>
 #include <iostream>
 
@@ -65,20 +72,38 @@ void constructNightClubLights(Scene& scene) {
     scene.lights.insert(scene.lights.end(), backWallLights.begin(), backWallLights.end());
 }
 
+void buildMaterialTable(Scene& scene) {
+    scene.materials.clear();
+    scene.materials.reserve(scene.meshes.size() + scene.instancedMeshes.size() + 1ULL);
+    scene.materials.emplace_back(); // MISS_MATERIAL_ID
+    for (const Mesh& mesh : scene.meshes)           { scene.materials.push_back(mesh.material); }
+    for (const Mesh& mesh : scene.instancedMeshes)  { scene.materials.push_back(mesh.material); }
+}
+
+void makeSceneDynamic(Scene& scene) {
+    for (Mesh& mesh : scene.meshes) {
+        scene.instances.push_back({ static_cast<uint32_t>(scene.instancedMeshes.size()), glm::identity<glm::mat4>() });
+        scene.instancedMeshes.push_back(std::move(mesh));
+    }
+    scene.meshes.clear();
+    scene.dynamic = true;
+    buildMaterialTable(scene);
+}
+
 Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir) {
     Scene scene;
     scene.type = type;
     switch (type) {
     case SingleTriangle: {
         // Load a 3D model with a single triangle
-        auto subMeshes = loadMesh(dataDir / "triangle.obj");
+        auto subMeshes = loadMeshCached(dataDir / "triangle.obj");
         subMeshes[0].material.kd = glm::vec3(1.0f);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
     } break;
     case Cube: {
         // Load a 3D model of a cube with 12 triangles
-        auto subMeshes = loadMesh(dataDir / "cube.obj");
+        auto subMeshes = loadMeshCached(dataDir / "cube.obj");
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         // scene.lights.push_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
         scene.lights.emplace_back(SegmentLight {
@@ -89,19 +114,19 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir) {
         });
     } break;
     case CubeTextured: {
-        auto subMeshes = loadMesh(dataDir / "cube-textured.obj");
+        auto subMeshes = loadMeshCached(dataDir / "cube-textured.obj");
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1.0, 1.5, -1.0), glm::vec3(1) });
     } break;
     case CornellBox: {
         // Load a 3D model of a Cornell Box
-        auto subMeshes = loadMesh(dataDir / "CornellBox-Mirror-Rotated.obj", true);
+        auto subMeshes = loadMeshCached(dataDir / "CornellBox-Mirror-Rotated.obj", true);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(0, 0.58f, 0), glm::vec3(1) }); // Light at the top of the box
     } break;
     case CornellBoxParallelogramLight: {
         // Load a 3D model of a Cornell Box
-        auto subMeshes = loadMesh(dataDir / "CornellBox-Mirror-Rotated.obj", true);
+        auto subMeshes = loadMeshCached(dataDir / "CornellBox-Mirror-Rotated.obj", true);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         // Light at the top of the box.
         scene.lights.emplace_back(ParallelogramLight {
@@ -115,26 +140,46 @@ Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir) {
         });
     } break;
     case CornellNightClub: {
-        auto subMeshes = loadMesh(dataDir / "cornell-nightclub.obj", false);
+        auto subMeshes = loadMeshCached(dataDir / "cornell-nightclub.obj", false);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         constructNightClubLights(scene);
     } break;
     case Monkey: {
         // Load a 3D model of a Monkey
-        auto subMeshes = loadMesh(dataDir / "monkey.obj", true);
+        auto subMeshes = loadMeshCached(dataDir / "monkey.obj", true);
         std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
         scene.lights.emplace_back(PointLight { glm::vec3(-1, 1, -1), glm::vec3(1) });
         scene.lights.emplace_back(PointLight { glm::vec3(1, -1, -1), glm::vec3(1) });
     } break;
+    case MonkeyInstanced: {
+        // Load the Monkey model once and place a grid of copies of it
+        auto subMeshes = loadMeshCached(dataDir / "monkey.obj", true);
+        std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.instancedMeshes));
+        constexpr int32_t gridHalfExtent    = 3;
+        constexpr float gridSpacing         = 2.5f;
+        for (int32_t gridX = -gridHalfExtent; gridX <= gridHalfExtent; gridX++) {
+            for (int32_t gridZ = -gridHalfExtent; gridZ <= gridHalfExtent; gridZ++) {
+                glm::mat4 transform = glm::translate(glm::identity<glm::mat4>(), glm::vec3(gridX * gridSpacing, 0.0f, gridZ * gridSpacing));
+                transform           = glm::rotate(transform, 0.3f * static_cast<float>(gridX + gridZ), glm::vec3(0.0f, 1.0f, 0.0f));
+                for (uint32_t meshIdx = 0U; meshIdx < scene.instancedMeshes.size(); meshIdx++) { scene.instances.push_back({ meshIdx, transform }); }
+            }
+        }
+        scene.lights.emplace_back(PointLight { glm::vec3(-4, 4, -4), glm::vec3(8) });
+        scene.lights.emplace_back(PointLight { glm::vec3(4, 4, 4), glm::vec3(8) });
+    } break;
     };
 
+    buildMaterialTable(scene);
+    scene.lightBuffer = compileLights(scene.lights);
     return scene;
 }
 
 Scene loadSceneFromFile(const std::filesystem::path& path, const std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>>& lights) {
     Scene scene;
     scene.lights    = std::move(lights);
-    auto subMeshes  = loadMesh(path);
+    auto subMeshes  = loadMeshCached(path);
     std::move(std::begin(subMeshes), std::end(subMeshes), std::back_inserter(scene.meshes));
+    buildMaterialTable(scene);
+    scene.lightBuffer = compileLights(scene.lights);
     return scene;
 }
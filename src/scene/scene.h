@@ -5,9 +5,11 @@
 
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 
+#include <scene/light_buffer.h>
 #include <utils/common.h>
 
 #include <filesystem>
@@ -23,21 +25,43 @@ enum SceneType {
     CornellBoxParallelogramLight,
     CornellNightClub,
     Monkey,
+    MonkeyInstanced,
+};
+
+struct MeshInstance {
+    uint32_t meshIdx;       // Index into Scene::instancedMeshes
+    glm::mat4 transform;    // Object-to-world transform of this placement
 };
 
 struct Scene {
     SceneType type;
     std::vector<Mesh> meshes;
+    std::vector<Mesh> instancedMeshes;      // Geometry built once and placed (possibly many times) through instances
+    std::vector<MeshInstance> instances;
     std::vector<Sphere> spheres;
-    std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>> lights;
+    std::vector<std::variant<PointLight, SegmentLight, ParallelogramLight>> lights; // Editable representation
+    LightBuffer lightBuffer;                // Lights as consumed by rendering, recompile with compileLights after editing lights
+    std::vector<Material> materials; // Immutable after loading, indexed by HitInfo::materialId
+    bool dynamic = false;            // Objects move or deform after loading, so acceleration structures are built for incremental updates
 };
 
+// Material table layout: a default material for misses, followed by the material of each mesh and then each instanced mesh in order
+constexpr uint32_t MISS_MATERIAL_ID = 0U;
+inline uint32_t meshMaterialId(size_t meshIdx) { return static_cast<uint32_t>(meshIdx) + 1U; }
+inline uint32_t instancedMeshMaterialId(const Scene& scene, size_t meshIdx) { return meshMaterialId(scene.meshes.size() + meshIdx); }
+
 std::vector<ParallelogramLight> regularLightGrid(glm::vec3 startPos, glm::ivec2 counts, glm::vec3 edge01, glm::vec3 edge02,
                                                  glm::vec3 color,
                                                  float emptySpacePercentage = 0.1f);
 
 void constructNightClubLights(Scene& scene);
 
+// Build the scene's material table from its meshes. Must be called once all meshes have been loaded
+void buildMaterialTable(Scene& scene);
+
+// Turn a loaded scene into a dynamic one where every mesh is placed through its own instance and can thus be transformed individually
+void makeSceneDynamic(Scene& scene);
+
 // Load a prebuilt scene.
 Scene loadScenePrebuilt(SceneType type, const std::filesystem::path& dataDir);
 
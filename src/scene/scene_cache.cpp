@@ -0,0 +1,314 @@
+#include "scene_cache.h"
+
+#ifdef _WIN32
+// Windows.h includes a ton of stuff we don't need, this macro tells it to include less junk.
+#define WIN32_LEAN_AND_MEAN
+// Disable legacy macro of min/max which breaks completely valid C++ code (std::min/std::max won't work).
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+static constexpr std::array<char, 8ULL> MESH_CACHE_MAGIC = { 'R', 'O', 'M', 'I', 'S', 'M', 'C', '\0' };
+static constexpr int64_t NO_TEXTURE                     = -1LL;
+
+// Fixed-size records of the cache file. The cache is a local artifact, so native endianness and layout are used
+struct CacheHeader {
+    std::array<char, 8ULL> magic;
+    uint32_t version;
+    uint32_t normalized;
+    uint64_t sourceHash;
+    uint64_t numTextures;
+    uint64_t numMeshes;
+};
+
+struct CacheTextureHeader {
+    int32_t width;
+    int32_t height;
+};
+
+struct CacheMeshHeader {
+    uint64_t numVertices;
+    uint64_t numTriangles;
+    float kd[3];
+    float ks[3];
+    float shininess;
+    float transparency;
+    int64_t textureIdx;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&)               = delete;
+    MappedFile& operator=(const MappedFile&)    = delete;
+
+    std::span<const std::byte> data() const { return { m_data, m_size }; }
+
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size           = 0ULL;
+#ifdef _WIN32
+    HANDLE m_file           = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping        = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) { throw std::runtime_error("Cannot open " + path.string()); }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(m_file, &fileSize);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    if (m_size == 0ULL) { return; }
+    m_mapping   = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_data      = m_mapping ? static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (!m_data) {
+        if (m_mapping) { CloseHandle(m_mapping); }
+        CloseHandle(m_file);
+        throw std::runtime_error("Cannot map " + path.string());
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)                         { UnmapViewOfFile(m_data); }
+    if (m_mapping)                      { CloseHandle(m_mapping); }
+    if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { throw std::runtime_error("Cannot open " + path.string()); }
+    struct stat fileStats;
+    if (fstat(fd, &fileStats) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path.string());
+    }
+    m_size = static_cast<size_t>(fileStats.st_size);
+    if (m_size == 0ULL) {
+        close(fd);
+        return;
+    }
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED) { throw std::runtime_error("Cannot map " + path.string()); }
+    m_data = static_cast<const std::byte*>(mapping);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) { munmap(const_cast<std::byte*>(m_data), m_size); }
+}
+#endif
+
+// 64-bit FNV-1a
+static uint64_t hashBytes(std::span<const std::byte> bytes, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (std::byte byte : bytes) {
+        hash ^= static_cast<uint64_t>(byte);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Gather the last whitespace-separated token of each line starting with the given keyword
+static std::vector<std::string> keywordArguments(std::span<const std::byte> bytes, std::string_view keyword) {
+    constexpr std::string_view whitespace = " \t\r";
+    std::vector<std::string> arguments;
+    std::string_view text(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    while (!text.empty()) {
+        // Split off next line and strip surrounding whitespace
+        const size_t lineEnd    = std::min(text.find('\n'), text.size());
+        std::string_view line   = text.substr(0ULL, lineEnd);
+        text.remove_prefix(lineEnd < text.size() ? lineEnd + 1ULL : lineEnd);
+        line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+        line = line.substr(0ULL, line.find_last_not_of(whitespace) + 1ULL);
+
+        // Keyword must be followed by at least one argument
+        if (!line.starts_with(keyword) || line.size() == keyword.size() || whitespace.find(line[keyword.size()]) == std::string_view::npos) { continue; }
+        arguments.emplace_back(line.substr(line.find_last_of(whitespace) + 1ULL));
+    }
+    return arguments;
+}
+
+// Hash the contents of an OBJ file and of the material libraries and diffuse textures it references
+static uint64_t hashSourceFiles(const std::filesystem::path& file) {
+    const std::filesystem::path baseDir = file.parent_path();
+    uint64_t hash                       = hashBytes({});
+    MappedFile obj(file);
+    hash = hashBytes(obj.data(), hash);
+    for (const std::string& materialLibrary : keywordArguments(obj.data(), "mtllib")) {
+        const std::filesystem::path mtlPath = baseDir / materialLibrary;
+        if (!std::filesystem::exists(mtlPath)) { continue; }
+        MappedFile mtl(mtlPath);
+        hash = hashBytes(mtl.data(), hash);
+        for (const std::string& texture : keywordArguments(mtl.data(), "map_Kd")) {
+            const std::filesystem::path texturePath = baseDir / texture;
+            if (!std::filesystem::exists(texturePath)) { continue; }
+            hash = hashBytes(MappedFile(texturePath).data(), hash);
+        }
+    }
+    return hash;
+}
+
+// Whether data holds at least count elements of type T. Counts are read from the file, so this is checked before allocating
+// storage for them, without computing their (possibly overflowing) byte size
+template <typename T>
+static bool holdsRecords(std::span<const std::byte> data, uint64_t count) { return count <= data.size() / sizeof(T); }
+
+// Consume count elements of trivially copyable type T from the front of data. Returns false if data is too short
+template <typename T>
+static bool readRecords(std::span<const std::byte>& data, T* out, size_t count) {
+    if (!holdsRecords<T>(data, count)) { return false; }
+    const size_t numBytes = sizeof(T) * count;
+    std::memcpy(out, data.data(), numBytes);
+    data = data.subspan(numBytes);
+    return true;
+}
+
+template <typename T>
+static void writeRecords(std::ofstream& out, const T* records, size_t count) {
+    out.write(reinterpret_cast<const char*>(records), static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+static std::optional<std::vector<Mesh>> readMeshCache(const std::filesystem::path& cachePath, bool normalize, uint64_t sourceHash) {
+    MappedFile cacheFile(cachePath);
+    std::span<const std::byte> data = cacheFile.data();
+
+    // Validate header
+    CacheHeader header;
+    if (!readRecords(data, &header, 1ULL)                                                       ||
+        header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION                ||
+        header.normalized != static_cast<uint32_t>(normalize) || header.sourceHash != sourceHash) { return std::nullopt; }
+
+    // Pre-decoded textures, shared by all meshes using them
+    std::vector<std::shared_ptr<Image>> textures;
+    for (uint64_t textureIdx = 0ULL; textureIdx < header.numTextures; textureIdx++) {
+        CacheTextureHeader textureHeader;
+        if (!readRecords(data, &textureHeader, 1ULL) || textureHeader.width < 0 || textureHeader.height < 0) { return std::nullopt; }
+        const size_t numPixels = static_cast<size_t>(textureHeader.width) * static_cast<size_t>(textureHeader.height); // Cannot overflow for 31-bit sides
+        if (!holdsRecords<glm::vec3>(data, numPixels)) { return std::nullopt; }
+        std::vector<glm::vec3> pixels(numPixels);
+        if (!readRecords(data, pixels.data(), pixels.size())) { return std::nullopt; }
+        textures.push_back(std::make_shared<Image>(textureHeader.width, textureHeader.height, std::move(pixels)));
+    }
+
+    // Meshes, each of which has at least a header left to read
+    if (!holdsRecords<CacheMeshHeader>(data, header.numMeshes)) { return std::nullopt; }
+    std::vector<Mesh> meshes(header.numMeshes);
+    for (Mesh& mesh : meshes) {
+        CacheMeshHeader meshHeader;
+        if (!readRecords(data, &meshHeader, 1ULL)) { return std::nullopt; }
+        if (meshHeader.textureIdx != NO_TEXTURE && (meshHeader.textureIdx < 0 || meshHeader.textureIdx >= static_cast<int64_t>(textures.size()))) { return std::nullopt; }
+        if (!holdsRecords<Vertex>(data, meshHeader.numVertices) ||
+            !holdsRecords<glm::uvec3>(data.subspan(sizeof(Vertex) * meshHeader.numVertices), meshHeader.numTriangles)) { return std::nullopt; }
+        mesh.vertices.reserve(meshHeader.numVertices + 1ULL); // Spare vertex of capacity, see loadMesh
+        mesh.vertices.resize(meshHeader.numVertices);
+        mesh.triangles.resize(meshHeader.numTriangles);
+        readRecords(data, mesh.vertices.data(), mesh.vertices.size());
+        readRecords(data, mesh.triangles.data(), mesh.triangles.size());
+        mesh.material.kd            = glm::vec3(meshHeader.kd[0], meshHeader.kd[1], meshHeader.kd[2]);
+        mesh.material.ks            = glm::vec3(meshHeader.ks[0], meshHeader.ks[1], meshHeader.ks[2]);
+        mesh.material.shininess     = meshHeader.shininess;
+        mesh.material.transparency  = meshHeader.transparency;
+        if (meshHeader.textureIdx != NO_TEXTURE) { mesh.material.kdTexture = textures[static_cast<size_t>(meshHeader.textureIdx)]; }
+    }
+    return meshes;
+}
+
+static void writeMeshCache(const std::filesystem::path& cachePath, const std::vector<Mesh>& meshes, bool normalize, uint64_t sourceHash) {
+    // Deduplicate textures shared between meshes
+    std::vector<const Image*> textures;
+    std::unordered_map<const Image*, int64_t> textureIndices;
+    for (const Mesh& mesh : meshes) {
+        const Image* texture = mesh.material.kdTexture.get();
+        if (texture && !textureIndices.contains(texture)) {
+            textureIndices[texture] = static_cast<int64_t>(textures.size());
+            textures.push_back(texture);
+        }
+    }
+
+    // Write to a temporary file first so that an interrupted write never leaves behind a cache which looks valid
+    const std::filesystem::path tempPath = std::filesystem::path(cachePath).concat(".tmp");
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Cannot write mesh cache " << cachePath << std::endl;
+            return;
+        }
+        CacheHeader header { MESH_CACHE_MAGIC, MESH_CACHE_VERSION, static_cast<uint32_t>(normalize), sourceHash, textures.size(), meshes.size() };
+        writeRecords(out, &header, 1ULL);
+        for (const Image* texture : textures) {
+            CacheTextureHeader textureHeader { texture->width, texture->height };
+            writeRecords(out, &textureHeader, 1ULL);
+            writeRecords(out, texture->pixels.data(), texture->pixels.size());
+        }
+        for (const Mesh& mesh : meshes) {
+            const Material& material = mesh.material;
+            CacheMeshHeader meshHeader {
+                .numVertices    = mesh.vertices.size(),
+                .numTriangles   = mesh.triangles.size(),
+                .kd             = { material.kd.x, material.kd.y, material.kd.z },
+                .ks             = { material.ks.x, material.ks.y, material.ks.z },
+                .shininess      = material.shininess,
+                .transparency   = material.transparency,
+                .textureIdx     = material.kdTexture ? textureIndices.at(material.kdTexture.get()) : NO_TEXTURE
+            };
+            writeRecords(out, &meshHeader, 1ULL);
+            writeRecords(out, mesh.vertices.data(), mesh.vertices.size());
+            writeRecords(out, mesh.triangles.data(), mesh.triangles.size());
+        }
+        if (!out) {
+            std::cerr << "Failed writing mesh cache " << cachePath << std::endl;
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) { std::cerr << "Cannot write mesh cache " << cachePath << ": " << error.message() << std::endl; }
+}
+
+std::filesystem::path meshCachePath(const std::filesystem::path& file, bool normalize) {
+    return std::filesystem::path(file).concat(normalize ? ".normalized.meshcache" : ".meshcache");
+}
+
+std::vector<Mesh> loadMeshCached(const std::filesystem::path& file, bool normalize) {
+    if (!std::filesystem::exists(file)) { return loadMesh(file, normalize); } // Let the regular loader report the missing file
+
+    // Use the cache if it was generated from the current version of the source files
+    const uint64_t sourceHash               = hashSourceFiles(file);
+    const std::filesystem::path cachePath   = meshCachePath(file, normalize);
+    if (std::filesystem::exists(cachePath)) {
+        try {
+            std::optional<std::vector<Mesh>> cachedMeshes = readMeshCache(cachePath, normalize, sourceHash);
+            if (cachedMeshes) { return std::move(*cachedMeshes); }
+        } catch (const std::runtime_error& error) {
+            std::cerr << "Ignoring unreadable mesh cache: " << error.what() << std::endl;
+        }
+    }
+
+    // Stale or missing cache: parse the source files and (re)generate it
+    std::vector<Mesh> meshes = loadMesh(file, normalize);
+    writeMeshCache(cachePath, meshes, normalize, sourceHash);
+    return meshes;
+}
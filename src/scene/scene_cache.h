@@ -0,0 +1,28 @@
+#pragma once
+#ifndef _SCENE_CACHE_H_
+#define _SCENE_CACHE_H_
+
+#include <framework/mesh.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+constexpr uint32_t MESH_CACHE_VERSION = 1U;
+
+/**
+ * Load a mesh through a binary cache stored next to the source file. The cache holds the deduplicated vertices, triangles,
+ * materials and decoded textures produced by loadMesh, and is validated against a hash of the OBJ file and all the material
+ * and texture files it references. A missing or stale cache is (re)written after parsing the source files
+ *
+ * @param file OBJ file to load
+ * @param normalize Center the meshes and scale them to unit size (see loadMesh)
+ *
+ * @return The meshes contained in the OBJ file, one per material
+*/
+std::vector<Mesh> loadMeshCached(const std::filesystem::path& file, bool normalize = false);
+
+// Path of the cache file holding the given OBJ file's preprocessed meshes
+std::filesystem::path meshCachePath(const std::filesystem::path& file, bool normalize);
+
+#endif // _SCENE_CACHE_H_
@@ -171,6 +171,13 @@ void drawScene(const Scene& scene)
 {
     for (const auto& mesh : scene.meshes)
         drawMesh(mesh);
+    for (const auto& instance : scene.instances) {
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glMultMatrixf(glm::value_ptr(instance.transform));
+        drawMesh(scene.instancedMeshes[instance.meshIdx]);
+        glPopMatrix();
+    }
     for (const auto& sphere : scene.spheres)
         drawSphere(sphere);
 }
@@ -10,6 +10,11 @@
 // Flag to enable/disable the debug drawing.
 extern bool enableDebugDraw;
 
+// Compile-time debug drawing policies of the tracing and visibility entry points.
+// Render passes use DebugDrawOff, which compiles all debug drawing (and its enableDebugDraw checks) away.
+struct DebugDrawOff { static constexpr bool enabled = false; };
+struct DebugDrawOn  { static constexpr bool enabled = true; };
+
 // Add your own custom visual debug draw functions here then implement it in draw.cpp.
 // You are free to modify the example one however you like.
 //
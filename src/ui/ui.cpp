@@ -14,27 +14,31 @@ DISABLE_WARNINGS_POP()
 #include <utils/magic_enum.hpp>
 #include <utils/utils.h>
 
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <variant>
 
 
 UiManager::UiManager(EmbreeInterface& embreeInterface, Trackball& camera, Config& config, std::optional<RayHit>& optDebugRayHit,
-                     std::shared_ptr<ReservoirGrid>& previousFrameGrid, Scene& scene, SceneType& sceneType,
+                     std::shared_ptr<AnyReservoirGrid>& previousFrameGrid, AnyReservoirGrid& swapGrid, Scene& scene, SceneType& sceneType,
                      Screen& screen, ViewMode& viewMode, Window& window,
-                     int& selectedLightIdx)
+                     int& selectedLightIdx, uint32_t& frameIdx)
     : embreeInterface(embreeInterface)
     , camera(camera)
     , config(config)
     , optDebugRayHit(optDebugRayHit)
     , previousFrameGrid(previousFrameGrid)
+    , spatialSwapGrid(swapGrid)
     , scene(scene)
     , sceneType(sceneType)
     , screen(screen)
     , viewMode(viewMode)
     , window(window)
     , selectedLightIdx(selectedLightIdx)
+    , frameIdx(frameIdx)
 {}
 
 void UiManager::draw() {
@@ -69,6 +73,9 @@ void UiManager::drawProjectTab() {
     ImGui::Spacing();
     ImGui::Separator();
     drawLightControls();
+    ImGui::Spacing();
+    ImGui::Separator();
+    drawObjectControls();
 }
 
 void UiManager::drawRayTracingTab() {
@@ -94,6 +101,7 @@ void UiManager::drawSceneSelection() {
         "Cornell Box (parallelogram light and mirror)",
         "Cornell Nightclub",
         "Monkey",
+        "Monkeys (instanced)",
         "Teapot",
         "Dragon",
         "Spheres",
@@ -158,8 +166,8 @@ void UiManager::drawRenderToFile() {
             // Perform a new render and measure the time it took to generate the image.
             using clock                             = std::chrono::high_resolution_clock;
             const auto start                        = clock::now();
-            std::optional<ReservoirGrid> maybeGrid  = renderRayTraced(previousFrameGrid, scene, camera, embreeInterface, screen, config.features);
-            if (maybeGrid) { previousFrameGrid      = std::make_shared<ReservoirGrid>(maybeGrid.value()); }
+            std::optional<AnyReservoirGrid> maybeGrid = renderRayTraced(previousFrameGrid, spatialSwapGrid, scene, camera, embreeInterface, screen, config.features, frameIdx++);
+            if (maybeGrid) { previousFrameGrid      = std::make_shared<AnyReservoirGrid>(maybeGrid.value()); }
             const auto end                          = clock::now();
             std::cout << "Time to render image: " << std::chrono::duration<float, std::milli>(end - start).count() << " milliseconds" << std::endl;
             
@@ -184,27 +192,29 @@ void UiManager::drawLightControls() {
     ImGui::Combo("Selected light", &selectedLightIdx, optionsPointers.data(), static_cast<int>(optionsPointers.size()));
     --selectedLightIdx;
 
+    // The light buffer is only recompiled when a light was changed, as reported by the controls editing it
+    bool lightsEdited = false;
     if (selectedLightIdx >= 0) {
         setOpenGLMatrices(camera);
         std::visit(
             make_visitor(
                 [&](PointLight& light) {
-                    showImGuizmoTranslation(window, camera, light.position); // 3D controls to translate light source.
-                    ImGui::DragFloat3("Light position", glm::value_ptr(light.position), 0.01f, -3.0f, 3.0f);
-                    ImGui::ColorEdit3("Light color", glm::value_ptr(light.color));
+                    lightsEdited |= showImGuizmoTranslation(window, camera, light.position); // 3D controls to translate light source.
+                    lightsEdited |= ImGui::DragFloat3("Light position", glm::value_ptr(light.position), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::ColorEdit3("Light color", glm::value_ptr(light.color));
                 },
                 [&](SegmentLight& light) {
                     // 3D controls to translate light source.
                     static int selectedEndpoint = 0;
-                    if (selectedEndpoint == 0)  { showImGuizmoTranslation(window, camera, light.endpoint0); }
-                    else                        { showImGuizmoTranslation(window, camera, light.endpoint1); }
+                    if (selectedEndpoint == 0)  { lightsEdited |= showImGuizmoTranslation(window, camera, light.endpoint0); }
+                    else                        { lightsEdited |= showImGuizmoTranslation(window, camera, light.endpoint1); }
 
                     const std::array<const char*, 2> endpointOptions { "Endpoint 0", "Endpoint 1" };
                     ImGui::Combo("Selected endpoint", &selectedEndpoint, endpointOptions.data(), int(endpointOptions.size()));
-                    ImGui::DragFloat3("Endpoint 0", glm::value_ptr(light.endpoint0), 0.01f, -3.0f, 3.0f);
-                    ImGui::DragFloat3("Endpoint 1", glm::value_ptr(light.endpoint1), 0.01f, -3.0f, 3.0f);
-                    ImGui::ColorEdit3("Color 0", glm::value_ptr(light.color0));
-                    ImGui::ColorEdit3("Color 1", glm::value_ptr(light.color1));
+                    lightsEdited |= ImGui::DragFloat3("Endpoint 0", glm::value_ptr(light.endpoint0), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::DragFloat3("Endpoint 1", glm::value_ptr(light.endpoint1), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::ColorEdit3("Color 0", glm::value_ptr(light.color0));
+                    lightsEdited |= ImGui::ColorEdit3("Color 1", glm::value_ptr(light.color1));
                 },
                 [&](ParallelogramLight& light) {
                     glm::vec3 vertex1 = light.v0 + light.edge01;
@@ -212,22 +222,22 @@ void UiManager::drawLightControls() {
 
                     // 3D controls to translate light source.
                     static int selectedVertex = 0;
-                    if (selectedVertex == 0)        { showImGuizmoTranslation(window, camera, light.v0); }
-                    else if (selectedVertex == 1)   { showImGuizmoTranslation(window, camera, vertex1); }
-                    else                            { showImGuizmoTranslation(window, camera, vertex2); }
+                    if (selectedVertex == 0)        { lightsEdited |= showImGuizmoTranslation(window, camera, light.v0); }
+                    else if (selectedVertex == 1)   { lightsEdited |= showImGuizmoTranslation(window, camera, vertex1); }
+                    else                            { lightsEdited |= showImGuizmoTranslation(window, camera, vertex2); }
 
                     const std::array<const char*, 3> vertexOptions { "Vertex 0", "Vertex 1", "Vertex 2" };
                     ImGui::Combo("Selected vertex", &selectedVertex, vertexOptions.data(), int(vertexOptions.size()));
-                    ImGui::DragFloat3("Vertex 0", glm::value_ptr(light.v0), 0.01f, -3.0f, 3.0f);
-                    ImGui::DragFloat3("Vertex 1", glm::value_ptr(vertex1), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::DragFloat3("Vertex 0", glm::value_ptr(light.v0), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::DragFloat3("Vertex 1", glm::value_ptr(vertex1), 0.01f, -3.0f, 3.0f);
                     light.edge01 = vertex1 - light.v0;
-                    ImGui::DragFloat3("Vertex 2", glm::value_ptr(vertex2), 0.01f, -3.0f, 3.0f);
+                    lightsEdited |= ImGui::DragFloat3("Vertex 2", glm::value_ptr(vertex2), 0.01f, -3.0f, 3.0f);
                     light.edge02 = vertex2 - light.v0;
 
-                    ImGui::ColorEdit3("Color 0", glm::value_ptr(light.color0));
-                    ImGui::ColorEdit3("Color 1", glm::value_ptr(light.color1));
-                    ImGui::ColorEdit3("Color 2", glm::value_ptr(light.color2));
-                    ImGui::ColorEdit3("Color 3", glm::value_ptr(light.color3));
+                    lightsEdited |= ImGui::ColorEdit3("Color 0", glm::value_ptr(light.color0));
+                    lightsEdited |= ImGui::ColorEdit3("Color 1", glm::value_ptr(light.color1));
+                    lightsEdited |= ImGui::ColorEdit3("Color 2", glm::value_ptr(light.color2));
+                    lightsEdited |= ImGui::ColorEdit3("Color 3", glm::value_ptr(light.color3));
                 },
                 [](auto) { /* any other type of light */ }),
             scene.lights[size_t(selectedLightIdx)]);
@@ -237,10 +247,12 @@ void UiManager::drawLightControls() {
     if (ImGui::Button("Add point light")) {
         selectedLightIdx = int(scene.lights.size());
         scene.lights.emplace_back(PointLight { .position = glm::vec3(0.0f), .color = glm::vec3(1.0f) });
+        lightsEdited = true;
     }
     if (ImGui::Button("Add segment light")) {
         selectedLightIdx = int(scene.lights.size());
         scene.lights.emplace_back(SegmentLight { .endpoint0 = glm::vec3(0.0f), .endpoint1 = glm::vec3(1.0f), .color0 = glm::vec3(1, 0, 0), .color1 = glm::vec3(0, 0, 1) });
+        lightsEdited = true;
     }
     if (ImGui::Button("Add parallelogram light")) {
         selectedLightIdx = int(scene.lights.size());
@@ -253,11 +265,59 @@ void UiManager::drawLightControls() {
             .color2 = glm::vec3(0, 0, 1),   // blue
             .color3 = glm::vec3(1, 1, 1)    // white
         });
+        lightsEdited = true;
     }
     if (selectedLightIdx >= 0 && ImGui::Button("Remove selected light")) {
         scene.lights.erase(std::begin(scene.lights) + selectedLightIdx);
         selectedLightIdx = -1;
+        lightsEdited = true;
     }
+    if (lightsEdited) { scene.lightBuffer = compileLights(scene.lights); }
+}
+
+void UiManager::drawObjectControls() {
+    ImGui::Text("Objects");
+
+    // Static scenes are built for traversal speed, objects can only be edited once every mesh is placed through its own instance
+    if (!scene.dynamic) {
+        if (ImGui::Button("Make scene dynamic")) {
+            makeSceneDynamic(scene);
+            embreeInterface.changeScene(scene);
+        }
+        return;
+    }
+    if (scene.instances.empty()) { return; }
+
+    // Configure object selection dropdown data
+    static int selectedInstance = 0;
+    selectedInstance = std::clamp(selectedInstance, 0, static_cast<int>(scene.instances.size()) - 1);
+    std::vector<std::string> options;
+    for (size_t i = 0; i < scene.instances.size(); i++) { options.push_back("Object " + std::to_string(i)); }
+    std::vector<const char*> optionsPointers;
+    std::transform(std::begin(options), std::end(options), std::back_inserter(optionsPointers), [](const auto& str) { return str.c_str(); });
+    ImGui::Combo("Selected object", &selectedInstance, optionsPointers.data(), static_cast<int>(optionsPointers.size()));
+
+    // Moving an object only updates its instance transform
+    const size_t instanceIdx    = size_t(selectedInstance);
+    MeshInstance& instance      = scene.instances[instanceIdx];
+    bool edited                 = false;
+    glm::vec3 position          = instance.transform[3];
+    if (ImGui::DragFloat3("Object position", glm::value_ptr(position), 0.01f)) {
+        instance.transform[3] = glm::vec4(position, 1.0f);
+        embreeInterface.setInstanceTransform(instanceIdx, instance.transform);
+        edited = true;
+    }
+
+    // Deforming an object refits the BVH of its mesh, which every instance of the mesh shares
+    static float normalOffset = 0.01f;
+    ImGui::DragFloat("Vertex normal offset", &normalOffset, 0.001f, -0.1f, 0.1f);
+    if (ImGui::Button("Offset vertices along normals")) {
+        std::vector<Vertex> vertices = scene.instancedMeshes[instance.meshIdx].vertices;
+        for (Vertex& vertex : vertices) { vertex.position += normalOffset * vertex.normal; }
+        embreeInterface.updateInstancedMeshVertices(scene, instance.meshIdx, vertices);
+        edited = true;
+    }
+    if (edited) { embreeInterface.commitUpdates(); }
 }
 
 void UiManager::drawRayTracingNeighbourSelectionParams() {
@@ -272,6 +332,9 @@ void UiManager::drawRayTracingFeaturesToggles() {
     if (ImGui::CollapsingHeader("Features", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Text("Common");
         ImGui::Checkbox("Initial samples - Visibility check",   &config.features.initialSamplesVisibilityCheck);
+        ImGui::Checkbox("Sort shadow rays by coherence",        &config.features.sortShadowRays);
+        ImGui::Checkbox("Octahedral G-buffer normals",          &config.features.octahedralNormals);
+        ImGui::Checkbox("Presampled light tiles",               &config.features.presampledLightTiles);
 
         ImGui::Spacing();
         ImGui::Separator();
@@ -287,6 +350,7 @@ void UiManager::drawRayTracingFeaturesToggles() {
         ImGui::Checkbox("Spatial reuse",                        &config.features.spatialReuse);
         ImGui::Checkbox("Spatial reuse - Visibility check",     &config.features.spatialReuseVisibilityCheck);
         ImGui::Checkbox("Temporal reuse",                       &config.features.temporalReuse);
+        ImGui::Checkbox("Compact reservoir history",            &config.features.compactReservoirs);
     }
 }
 
@@ -306,6 +370,21 @@ void UiManager::drawRayTracingParams() {
         ImGui::SliderInt("Canonical sample count",  (int*) &config.features.initialLightSamples,        1, 256);
         ImGui::SliderInt("Neighbours to sample",    (int*) &config.features.numNeighboursToSample,      0, 10);
         ImGui::SliderInt("Spatial resample radius", (int*) &config.features.spatialResampleRadius,      1, 30);
+        constexpr auto sampleSequences = magic_enum::enum_names<SampleSequence>();
+        std::vector<const char*> sampleSequencesPointers;
+        std::transform(std::begin(sampleSequences), std::end(sampleSequences), std::back_inserter(sampleSequencesPointers),
+                       [](const auto& str) { return str.data(); });
+        ImGui::Combo("Sample sequence", (int*) &config.features.sampleSequence, sampleSequencesPointers.data(), static_cast<int>(sampleSequencesPointers.size()));
+        constexpr auto lightSelectionStrategies = magic_enum::enum_names<LightSelectionStrategy>();
+        std::vector<const char*> lightSelectionStrategiesPointers;
+        std::transform(std::begin(lightSelectionStrategies), std::end(lightSelectionStrategies), std::back_inserter(lightSelectionStrategiesPointers),
+                       [](const auto& str) { return str.data(); });
+        ImGui::Combo("Light selection", (int*) &config.features.lightSelection, lightSelectionStrategiesPointers.data(), static_cast<int>(lightSelectionStrategiesPointers.size()));
+        constexpr auto targetFunctions = magic_enum::enum_names<TargetFunction>();
+        std::vector<const char*> targetFunctionsPointers;
+        std::transform(std::begin(targetFunctions), std::end(targetFunctions), std::back_inserter(targetFunctionsPointers),
+                       [](const auto& str) { return str.data(); });
+        ImGui::Combo("Candidate target function", (int*) &config.features.candidateTarget, targetFunctionsPointers.data(), static_cast<int>(targetFunctionsPointers.size()));
 
         ImGui::Spacing();
         ImGui::Separator();
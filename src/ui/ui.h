@@ -3,7 +3,7 @@
 #define _UI_H_
 
 #include <ray_tracing/embree_interface.h>
-#include <rendering/reservoir.h>
+#include <rendering/reservoir_grid.h>
 #include <rendering/screen.h>
 #include <scene/scene.h>
 #include <utils/common.h>
@@ -15,9 +15,9 @@
 class UiManager {
 public:
     UiManager(EmbreeInterface& embreeInterface, Trackball& camera, Config& config, std::optional<RayHit>& optDebugRayHit,
-              std::shared_ptr<ReservoirGrid>& previousFrameGrid, Scene& scene, SceneType& sceneType,
+              std::shared_ptr<AnyReservoirGrid>& previousFrameGrid, AnyReservoirGrid& swapGrid, Scene& scene, SceneType& sceneType,
               Screen& screen, ViewMode& viewMode, Window& window,
-              int& selectedLightIdx);
+              int& selectedLightIdx, uint32_t& frameIdx);
 
     void draw();
 
@@ -27,7 +27,8 @@ private:
     Trackball& camera;
     Config& config;
     std::optional<RayHit>& optDebugRayHit;
-    std::shared_ptr<ReservoirGrid>& previousFrameGrid;
+    std::shared_ptr<AnyReservoirGrid>& previousFrameGrid;
+    AnyReservoirGrid& spatialSwapGrid;
     Scene& scene;
     SceneType& sceneType;
     Screen& screen;
@@ -36,6 +37,7 @@ private:
 
     // External primitive handles
     int& selectedLightIdx;
+    uint32_t& frameIdx;
 
     // Final project template UI bits
     void drawProjectTab();
@@ -45,6 +47,7 @@ private:
     void drawCameraStats();
     void drawRenderToFile();
     void drawLightControls();
+    void drawObjectControls();
 
     // Ray-tracing UI bits
     void drawRayTracingTab();
@@ -33,6 +33,24 @@ enum class MISWeightRMIS {
     Balance
 };
 
+enum class LightSelectionStrategy {
+    Uniform = 0,
+    Power,
+    BVH
+};
+
+enum class SampleSequence {
+    Random = 0,
+    Sobol,
+    BlueNoise
+};
+
+// Target function initial candidates are resampled with. Later resampling stages always use the exact Phong target
+enum class TargetFunction {
+    Phong = 0,  // Exact shading
+    Geometric   // Unshadowed light color, diffuse plus specular albedo, cosine and inverse square falloff, without the specular lobe's angular term
+};
+
 enum class NeighbourSelectionStrategy {
     Random = 0,
     Similar,
@@ -41,11 +59,15 @@ enum class NeighbourSelectionStrategy {
 };
 
 struct HitInfo {
-    glm::vec3 normal;
-    glm::vec3 barycentricCoord;
-    glm::vec2 texCoord;
-    Material material;
+    // Raw hit record
     uint32_t geometryId;
+    uint32_t primitiveId;
+    glm::vec2 barycentricCoord;
+    uint32_t materialId = 0U; // Index into Scene::materials. Rays which hit nothing keep the default material at index 0
+
+    // Interpolated surface attributes, resolved on demand (see EmbreeInterface::resolveHitAttributes)
+    glm::vec3 normal;
+    glm::vec2 texCoord;     // Only resolved for textured materials
 };
 
 struct RayHit {
@@ -100,12 +122,18 @@ struct Features {
     uint32_t maxReflectionRecursion = 5U;
 
     // Shared R-MIS/ReSTIR feature flag(s) and parameter(s)
-    RayTraceMode rayTraceMode           = RayTraceMode::ROMIS;
-    bool initialSamplesVisibilityCheck  = false;
-    uint32_t numSamplesInReservoir      = 2U;
-    uint32_t initialLightSamples        = 32U;
-    uint32_t numNeighboursToSample      = 5U;
-    uint32_t spatialResampleRadius      = 10U;
+    RayTraceMode rayTraceMode             = RayTraceMode::ROMIS;
+    bool initialSamplesVisibilityCheck    = false;
+    bool sortShadowRays                   = false;
+    bool octahedralNormals                = false; // Keep G-buffer normals octahedral-encoded in 4 bytes
+    SampleSequence sampleSequence         = SampleSequence::Random;
+    LightSelectionStrategy lightSelection = LightSelectionStrategy::Power;
+    bool presampledLightTiles             = false;
+    TargetFunction candidateTarget        = TargetFunction::Phong;
+    uint32_t numSamplesInReservoir        = 2U;
+    uint32_t initialLightSamples          = 32U;
+    uint32_t numNeighboursToSample        = 5U;
+    uint32_t spatialResampleRadius        = 10U;
 
     // Neighbour selection heuristics controls
     bool neighbourSameGeometry                      = true;
@@ -125,6 +153,7 @@ struct Features {
     bool spatialReuse                   = true;
     bool spatialReuseVisibilityCheck    = false;
     bool temporalReuse                  = true;
+    bool compactReservoirs              = false;    // Keep temporal history in 16-byte compact form (see CompactSample)
 
     // ReSTIR parameters
     uint32_t spatialResamplingPasses    = 2U;
@@ -139,9 +168,9 @@ struct Features {
     void serialize(Archive& archive) const {
         archive(CEREAL_NVP(enableShading), CEREAL_NVP(enableRecursive), CEREAL_NVP(enableHardShadow), CEREAL_NVP(enableSoftShadow), CEREAL_NVP(enableNormalInterp), CEREAL_NVP(enableTextureMapping), CEREAL_NVP(enableAccelStructure),
                 CEREAL_NVP(maxReflectionRecursion),
-                CEREAL_NVP(rayTraceMode), CEREAL_NVP(initialSamplesVisibilityCheck), CEREAL_NVP(numSamplesInReservoir), CEREAL_NVP(initialLightSamples), CEREAL_NVP(numNeighboursToSample), CEREAL_NVP(spatialResampleRadius),
+                CEREAL_NVP(rayTraceMode), CEREAL_NVP(initialSamplesVisibilityCheck), CEREAL_NVP(sortShadowRays), CEREAL_NVP(octahedralNormals), CEREAL_NVP(sampleSequence), CEREAL_NVP(lightSelection), CEREAL_NVP(presampledLightTiles), CEREAL_NVP(candidateTarget), CEREAL_NVP(numSamplesInReservoir), CEREAL_NVP(initialLightSamples), CEREAL_NVP(numNeighboursToSample), CEREAL_NVP(spatialResampleRadius),
                 CEREAL_NVP(maxIterationsMIS), CEREAL_NVP(neighbourSelectionStrategy), CEREAL_NVP(misWeightRMIS), CEREAL_NVP(useProgressiveROMIS), CEREAL_NVP(progressiveUpdateMod), CEREAL_NVP(saveAlphasVisualisation),
-                CEREAL_NVP(unbiasedCombination), CEREAL_NVP(spatialReuse), CEREAL_NVP(spatialReuseVisibilityCheck), CEREAL_NVP(temporalReuse),
+                CEREAL_NVP(unbiasedCombination), CEREAL_NVP(spatialReuse), CEREAL_NVP(spatialReuseVisibilityCheck), CEREAL_NVP(temporalReuse), CEREAL_NVP(compactReservoirs),
                 CEREAL_NVP(spatialResamplingPasses), CEREAL_NVP(temporalClampM),
                 CEREAL_NVP(enableToneMapping), CEREAL_NVP(gamma), CEREAL_NVP(exposure)); 
     }
@@ -41,6 +41,10 @@ static std::ostream& operator<<(std::ostream& os, const SceneType& sceneType)
         os << "SceneType::Monkey";
         break;
     }
+    case SceneType::MonkeyInstanced: {
+        os << "SceneType::MonkeyInstanced";
+        break;
+    }
     case SceneType::CornellNightClub: {
         os << "SceneType::CornellNightClub";
         break;
@@ -317,6 +321,8 @@ std::string serialize(const SceneType& sceneType)
         return "cornell_box_parallelogram_light";
     case SceneType::Monkey:
         return "monkey";
+    case SceneType::MonkeyInstanced:
+        return "monkey_instanced";
     default:
         return "unknown";
     }
@@ -338,6 +344,8 @@ std::optional<SceneType> deserialize(const std::string& sceneTypeStr)
         return SceneType::CornellBoxParallelogramLight;
     } else if (lowered == "monkey") {
         return SceneType::Monkey;
+    } else if (lowered == "monkey_instanced" || lowered == "monkeyinstanced" || lowered == "monkey-instanced") {
+        return SceneType::MonkeyInstanced;
     } else {
         return std::nullopt;
     }
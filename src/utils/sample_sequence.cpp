@@ -0,0 +1,161 @@
+#include "sample_sequence.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+// Sobol direction numbers. The first dimension is the van der Corput sequence, the rest use the primitive polynomials
+// and initial direction numbers of Joe and Kuo (new-joe-kuo-6.21201)
+using SobolDirections = std::array<std::array<uint32_t, 32ULL>, SOBOL_DIMENSIONS>;
+static constexpr SobolDirections computeSobolDirections() {
+    struct PrimitivePolynomial { uint32_t degree; uint32_t coefficients; std::array<uint32_t, 3ULL> initialDirections; };
+    constexpr std::array<PrimitivePolynomial, SOBOL_DIMENSIONS - 1U> polynomials = {{ { 1U, 0U, { 1U, 0U, 0U } },
+                                                                                      { 2U, 1U, { 1U, 3U, 0U } },
+                                                                                      { 3U, 1U, { 1U, 3U, 1U } } }};
+    SobolDirections directions {};
+    for (uint32_t bit = 0U; bit < 32U; bit++) { directions[0][bit] = 1U << (31U - bit); }
+    for (uint32_t dimension = 1U; dimension < SOBOL_DIMENSIONS; dimension++) {
+        const PrimitivePolynomial& polynomial   = polynomials[dimension - 1U];
+        std::array<uint32_t, 32ULL>& v          = directions[dimension];
+        for (uint32_t bit = 0U; bit < 32U; bit++) {
+            if (bit < polynomial.degree) { v[bit] = polynomial.initialDirections[bit] << (31U - bit); continue; }
+            v[bit] = v[bit - polynomial.degree] ^ (v[bit - polynomial.degree] >> polynomial.degree);
+            for (uint32_t term = 1U; term < polynomial.degree; term++) {
+                if ((polynomial.coefficients >> (polynomial.degree - 1U - term)) & 1U) { v[bit] ^= v[bit - term]; }
+            }
+        }
+    }
+    return directions;
+}
+static constexpr SobolDirections SOBOL_DIRECTIONS = computeSobolDirections();
+
+uint32_t sobol(uint32_t index, uint32_t dimension) {
+    uint32_t value = 0U;
+    for (uint32_t bit = 0U; index != 0U; index >>= 1U, bit++) {
+        if (index & 1U) { value ^= SOBOL_DIRECTIONS[dimension][bit]; }
+    }
+    return value;
+}
+
+static uint32_t reverseBits(uint32_t value) {
+    value = ((value >> 1U) & 0x55555555U) | ((value & 0x55555555U) << 1U);
+    value = ((value >> 2U) & 0x33333333U) | ((value & 0x33333333U) << 2U);
+    value = ((value >> 4U) & 0x0F0F0F0FU) | ((value & 0x0F0F0F0FU) << 4U);
+    value = ((value >> 8U) & 0x00FF00FFU) | ((value & 0x00FF00FFU) << 8U);
+    return (value >> 16U) | (value << 16U);
+}
+
+// Laine-Karras style hash, only ever propagates bits upwards, which makes it an Owen scramble of the reversed bits
+static uint32_t laineKarrasPermutation(uint32_t value, uint32_t seed) {
+    value += seed;
+    value ^= value * 0x6c50b47cU;
+    value ^= value * 0xb82f1e52U;
+    value ^= value * 0xc7afe638U;
+    value ^= value * 0x8d22f6e6U;
+    return value;
+}
+
+uint32_t nestedUniformScramble(uint32_t value, uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(value), seed));
+}
+
+float sobolOwen(uint32_t index, uint32_t dimension, uint32_t seed) {
+    const uint32_t setSeed          = hashCombine(seed, dimension / SOBOL_DIMENSIONS);
+    const uint32_t lane             = dimension % SOBOL_DIMENSIONS;
+    const uint32_t shuffledIndex    = nestedUniformScramble(index, setSeed); // Decorrelates the sets of four dimensions from each other
+    return toUnitFloat(nestedUniformScramble(sobol(shuffledIndex, lane), hashCombine(setSeed, lane + 1U)));
+}
+
+float blueNoiseSobol(const glm::ivec2& pixel, uint32_t index, uint32_t dimension, uint32_t seed) {
+    const uint32_t setSeed          = hashCombine(seed, dimension / SOBOL_DIMENSIONS);
+    const uint32_t lane             = dimension % SOBOL_DIMENSIONS;
+    const uint32_t shuffledIndex    = nestedUniformScramble(index, setSeed);
+
+    // Offset the mask differently per dimension so the rotations of different dimensions are uncorrelated
+    constexpr uint32_t maskWrap     = BLUE_NOISE_MASK_SIZE - 1U;
+    constexpr uint32_t rankShift    = 32U - std::countr_zero(BLUE_NOISE_MASK_SIZE * BLUE_NOISE_MASK_SIZE);
+    const uint32_t maskOffset       = hashCombine(setSeed, lane + 1U);
+    const uint32_t maskX            = (static_cast<uint32_t>(pixel.x) + maskOffset) & maskWrap;
+    const uint32_t maskY            = (static_cast<uint32_t>(pixel.y) + (maskOffset >> 16U)) & maskWrap;
+    const uint32_t rotation         = (static_cast<uint32_t>(blueNoiseMask()[(maskY * BLUE_NOISE_MASK_SIZE) + maskX]) << rankShift) + (1U << (rankShift - 1U));
+
+    // Cranley-Patterson rotation, the fixed point addition wraps around modulo one
+    return toUnitFloat(sobol(shuffledIndex, lane) + rotation);
+}
+
+// Void-and-cluster (Ulichney, "The void-and-cluster method for dither array generation", 1993) on a torus
+static std::vector<uint16_t> generateBlueNoiseMask() {
+    constexpr uint32_t size         = BLUE_NOISE_MASK_SIZE;
+    constexpr uint32_t numPixels    = size * size;
+    constexpr uint32_t numInitial   = numPixels / 10U;
+    constexpr float sigma           = 1.5f;
+
+    // Gaussian energy contributed by a point at every toroidal offset
+    std::vector<float> kernel(numPixels);
+    for (uint32_t y = 0U; y < size; y++) {
+        for (uint32_t x = 0U; x < size; x++) {
+            const float dx              = static_cast<float>(std::min(x, size - x));
+            const float dy              = static_cast<float>(std::min(y, size - y));
+            kernel[(y * size) + x]      = std::exp(-((dx * dx) + (dy * dy)) / (2.0f * sigma * sigma));
+        }
+    }
+    std::vector<float> energy(numPixels, 0.0f);
+    std::vector<bool> pattern(numPixels, false);
+    const auto togglePoint = [&](uint32_t pixel, bool set) {
+        pattern[pixel]          = set;
+        const uint32_t pixelX   = pixel % size;
+        const uint32_t pixelY   = pixel / size;
+        const float sign        = set ? 1.0f : -1.0f;
+        for (uint32_t y = 0U; y < size; y++) {
+            const uint32_t kernelRow = ((y - pixelY) & (size - 1U)) * size;
+            for (uint32_t x = 0U; x < size; x++) { energy[(y * size) + x] += sign * kernel[kernelRow + ((x - pixelX) & (size - 1U))]; }
+        }
+    };
+    const auto tightestCluster = [&]() {
+        uint32_t best = 0U; float bestEnergy = std::numeric_limits<float>::lowest();
+        for (uint32_t pixel = 0U; pixel < numPixels; pixel++) { if (pattern[pixel] && energy[pixel] > bestEnergy) { best = pixel; bestEnergy = energy[pixel]; } }
+        return best;
+    };
+    const auto largestVoid = [&]() {
+        uint32_t best = 0U; float bestEnergy = std::numeric_limits<float>::max();
+        for (uint32_t pixel = 0U; pixel < numPixels; pixel++) { if (!pattern[pixel] && energy[pixel] < bestEnergy) { best = pixel; bestEnergy = energy[pixel]; } }
+        return best;
+    };
+
+    // Deterministic white-noise initial pattern, relaxed until moving the tightest cluster no longer fills a larger void
+    for (uint32_t placed = 0U, counter = 0U; placed < numInitial; counter++) {
+        const uint32_t pixel = pcgHash(counter) % numPixels;
+        if (!pattern[pixel]) { togglePoint(pixel, true); placed++; }
+    }
+    while (true) {
+        const uint32_t cluster = tightestCluster();
+        togglePoint(cluster, false);
+        const uint32_t voidPixel = largestVoid();
+        togglePoint(voidPixel, true);
+        if (voidPixel == cluster) { break; }
+    }
+    const std::vector<bool> initialPattern  = pattern;
+    const std::vector<float> initialEnergy  = energy;
+
+    // Rank the initial points by removing tightest clusters, then the remaining pixels by filling the largest voids
+    std::vector<uint16_t> ranks(numPixels, 0U);
+    for (uint32_t rank = numInitial; rank > 0U; rank--) {
+        const uint32_t cluster = tightestCluster();
+        togglePoint(cluster, false);
+        ranks[cluster] = static_cast<uint16_t>(rank - 1U);
+    }
+    pattern = initialPattern;
+    energy  = initialEnergy;
+    for (uint32_t rank = numInitial; rank < numPixels; rank++) {
+        const uint32_t voidPixel = largestVoid();
+        togglePoint(voidPixel, true);
+        ranks[voidPixel] = static_cast<uint16_t>(rank);
+    }
+    return ranks;
+}
+
+const std::vector<uint16_t>& blueNoiseMask() {
+    static const std::vector<uint16_t> mask = generateBlueNoiseMask();
+    return mask;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef _SAMPLE_SEQUENCE_H_
+#define _SAMPLE_SEQUENCE_H_
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t SOBOL_DIMENSIONS         = 4U;   // Sobol dimensions evaluated directly, higher dimensions are padded with independently scrambled copies
+constexpr uint32_t BLUE_NOISE_MASK_SIZE     = 64U;  // Side length of the tiled blue-noise mask (power of two)
+
+// PCG output permutation of a single 32-bit value (Jarzynski and Olano, "Hash Functions for GPU Rendering", 2020)
+inline uint32_t pcgHash(uint32_t value) {
+    uint32_t state  = value * 747796405U + 2891336453U;
+    uint32_t word   = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+    return (word >> 22U) ^ word;
+}
+
+// Four-dimensional PCG hash, every output component depends on every input component (same paper as above)
+inline glm::uvec4 pcg4d(glm::uvec4 v) {
+    v = v * 1664525U + 1013904223U;
+    v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+    v ^= v >> 16U;
+    v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+    return v;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t value) { return seed ^ (pcgHash(value) + 0x9e3779b9U + (seed << 6U) + (seed >> 2U)); }
+
+// Map 32 random bits to a float in [0, 1)
+inline float toUnitFloat(uint32_t bits) { return static_cast<float>(bits >> 8U) * 0x1p-24f; }
+
+// Unscrambled Sobol sequence, as a 32-bit fixed point fraction. Dimension must be below SOBOL_DIMENSIONS
+uint32_t sobol(uint32_t index, uint32_t dimension);
+
+// Owen scrambling of a 32-bit fixed point fraction (Burley, "Practical Hash-based Owen Scrambling", 2020)
+uint32_t nestedUniformScramble(uint32_t value, uint32_t seed);
+
+/**
+ * Dimension of a point of an Owen-scrambled Sobol sequence. Dimensions are grouped in sets of four, each of which is
+ * scrambled and shuffled with its own seed, so any number of dimensions can be drawn
+ *
+ * @param index Index of the point in the sequence
+ * @param dimension Dimension of the point
+ * @param seed Scrambling seed, different seeds produce decorrelated sequences
+ *
+ * @return Value in [0, 1)
+*/
+float sobolOwen(uint32_t index, uint32_t dimension, uint32_t seed);
+
+/**
+ * Dimension of a point of a Sobol sequence shared by all pixels and toroidally shifted per pixel by a blue-noise mask
+ * (Georgiev and Fajardo, "Blue-noise Dithered Sampling", 2016). The error of neighbouring pixels is anti-correlated,
+ * which leaves blue-noise rather than white-noise error in the image
+ *
+ * @param pixel Pixel the value is drawn for
+ * @param index Index of the point in the sequence
+ * @param dimension Dimension of the point
+ * @param seed Seed shared by all pixels of the frame, shuffles the sequence and offsets the mask per dimension
+ *
+ * @return Value in [0, 1)
+*/
+float blueNoiseSobol(const glm::ivec2& pixel, uint32_t index, uint32_t dimension, uint32_t seed);
+
+// Ranks of a BLUE_NOISE_MASK_SIZE^2 void-and-cluster blue-noise mask, row major. Generated on first use
+const std::vector<uint16_t>& blueNoiseMask();
+
+#endif // _SAMPLE_SEQUENCE_H_
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <utils/common.h>
+#include <utils/sample_sequence.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Independent random streams consumed while rendering a frame
+enum class SampleStream : uint32_t {
+    InitialSamples = 0U,
+    NeighbourSelection,
+    TemporalReuse,
+    SpatialReuse,
+    LightPresampling,
+    LightTileSelection
+};
+
+/**
+ * Counter-based random number generator. The n-th value drawn is a pure function of (pixel, frame, stream, pass, n), so
+ * threads share no state and a render is reproducible regardless of thread count or the order in which pixels are processed.
+ * Cheap enough to construct wherever a pixel's random numbers are needed
+ *
+ * Uniform values (next1D and everything built on it) can alternatively be drawn from a low-discrepancy sequence. Callers mark
+ * the start of each multi-dimensional sample (e.g. a light candidate) with startSample, and successive values are successive
+ * dimensions of that sample's point. Raw bits (nextUint) are always independent random numbers
+*/
+class Sampler {
+public:
+    /**
+     * @param pixel Pixel the random numbers are drawn for
+     * @param frame Index of the frame being rendered
+     * @param stream Stage of the frame consuming the random numbers
+     * @param pass Repetition of the stage within the frame (spatial reuse pass, MIS iteration, ...)
+     * @param sequence Sequence uniform values are drawn from
+    */
+    Sampler(const glm::ivec2& pixel, uint32_t frame, SampleStream stream, uint32_t pass = 0U, SampleSequence sequence = SampleSequence::Random)
+        : m_key(static_cast<uint32_t>(pixel.x), static_cast<uint32_t>(pixel.y), frame, pcgHash((static_cast<uint32_t>(stream) << 16U) ^ pass))
+        , m_pixel(pixel)
+        , m_sequence(sequence) {
+        // Sobol points are scrambled per pixel, while the blue-noise dithered sequence is shared by all pixels of the frame
+        if (m_sequence == SampleSequence::Sobol)            { m_sequenceSeed = pcg4d(m_key).x; }
+        else if (m_sequence == SampleSequence::BlueNoise)   { m_sequenceSeed = pcg4d(glm::uvec4(0U, 0U, m_key.z, m_key.w)).x; }
+    }
+
+    // Start the given point of the low-discrepancy sequence. Subsequent uniform values are its dimensions, from the given one onwards
+    void startSample(uint32_t sampleIdx, uint32_t dimension = 0U) {
+        m_sampleIdx         = sampleIdx;
+        m_sequenceDimension = dimension;
+    }
+
+    // Uniformly distributed 32-bit value. Values are hashed four at a time
+    uint32_t nextUint() {
+        const uint32_t lane = m_dimension & 3U;
+        if (lane == 0U) { m_values = pcg4d(m_key + glm::uvec4(0U, 0U, 0U, m_dimension >> 2U)); }
+        m_dimension++;
+        return m_values[static_cast<glm::length_t>(lane)];
+    }
+
+    // Uniform float in [0, 1)
+    float next1D() {
+        switch (m_sequence) {
+            case SampleSequence::Sobol:     { return sobolOwen(m_sampleIdx, m_sequenceDimension++, m_sequenceSeed); }
+            case SampleSequence::BlueNoise: { return blueNoiseSobol(m_pixel, m_sampleIdx, m_sequenceDimension++, m_sequenceSeed); }
+            default:                        { return toUnitFloat(nextUint()); }
+        }
+    }
+
+    // Uniform float in [0, 1) from independent random bits, regardless of the sequence. For decisions which must not be
+    // correlated with the dimensions of a sample's point, such as resampling acceptance
+    float nextRandom1D() { return toUnitFloat(nextUint()); }
+
+    // Uniform integer in [0, count). Random bits use Lemire's multiply-shift range reduction
+    uint32_t nextIndex(uint32_t count) {
+        if (m_sequence == SampleSequence::Random) { return static_cast<uint32_t>((static_cast<uint64_t>(nextUint()) * count) >> 32U); }
+        return std::min(static_cast<uint32_t>(next1D() * static_cast<float>(count)), count - 1U);
+    }
+
+    // Uniform integer in [min, max]
+    int32_t nextInt(int32_t min, int32_t max) { return min + static_cast<int32_t>(nextIndex(static_cast<uint32_t>(max - min) + 1U)); }
+
+    // Number of random bit words drawn so far
+    uint32_t dimension() const { return m_dimension; }
+
+    // UniformRandomBitGenerator interface, for use with standard library algorithms such as std::sample
+    using result_type = uint32_t;
+    static constexpr result_type min() { return std::numeric_limits<result_type>::min(); }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    result_type operator()() { return nextUint(); }
+
+private:
+    // Random bits
+    glm::uvec4 m_key;
+    glm::uvec4 m_values     = glm::uvec4(0U);
+    uint32_t m_dimension    = 0U;
+
+    // Low-discrepancy sequence state
+    glm::ivec2 m_pixel;
+    SampleSequence m_sequence;
+    uint32_t m_sequenceSeed         = 0U;
+    uint32_t m_sampleIdx            = 0U;
+    uint32_t m_sequenceDimension    = 0U;
+};
+
+#endif // _SAMPLER_H_
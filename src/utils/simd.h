@@ -0,0 +1,186 @@
+#pragma once
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+// MSVC implies FMA with /arch:AVX2 without defining __FMA__
+#if defined(__AVX512F__)
+#define SIMD_AVX512
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define SIMD_AVX2
+#endif
+
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+/**
+ * Thin wrapper around the widest float vector available at compile time: 16 lanes with AVX-512, 8 with AVX2 and a
+ * single scalar lane otherwise, so kernels are written once for every target. Provides only what those kernels need
+*/
+namespace simd {
+
+#if defined(SIMD_AVX512)
+constexpr size_t LANES = 16ULL;
+
+struct Float { __m512 v; };
+struct Mask { __mmask16 m; };
+
+inline Float broadcast(float value)             { return { _mm512_set1_ps(value) }; }
+inline Float load(const float* values)          { return { _mm512_loadu_ps(values) }; }
+inline void store(float* values, Float value)   { _mm512_storeu_ps(values, value.v); }
+
+inline Float operator+(Float lhs, Float rhs)    { return { _mm512_add_ps(lhs.v, rhs.v) }; }
+inline Float operator-(Float lhs, Float rhs)    { return { _mm512_sub_ps(lhs.v, rhs.v) }; }
+inline Float operator*(Float lhs, Float rhs)    { return { _mm512_mul_ps(lhs.v, rhs.v) }; }
+inline Float operator/(Float lhs, Float rhs)    { return { _mm512_div_ps(lhs.v, rhs.v) }; }
+inline Float fmadd(Float a, Float b, Float c)   { return { _mm512_fmadd_ps(a.v, b.v, c.v) }; }
+inline Float sqrt(Float value)                  { return { _mm512_sqrt_ps(value.v) }; }
+inline Float abs(Float value)                   { return { _mm512_abs_ps(value.v) }; }
+inline Float min(Float lhs, Float rhs)          { return { _mm512_min_ps(lhs.v, rhs.v) }; }
+inline Float max(Float lhs, Float rhs)          { return { _mm512_max_ps(lhs.v, rhs.v) }; }
+inline Float round(Float value)                 { return { _mm512_roundscale_ps(value.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+
+inline Mask operator<(Float lhs, Float rhs)     { return { _mm512_cmp_ps_mask(lhs.v, rhs.v, _CMP_LT_OQ) }; }
+inline Mask operator>(Float lhs, Float rhs)     { return { _mm512_cmp_ps_mask(lhs.v, rhs.v, _CMP_GT_OQ) }; }
+inline Mask operator==(Float lhs, Float rhs)    { return { _mm512_cmp_ps_mask(lhs.v, rhs.v, _CMP_EQ_OQ) }; }
+inline Mask isNaN(Float value)                  { return { _mm512_cmp_ps_mask(value.v, value.v, _CMP_UNORD_Q) }; }
+inline Mask operator|(Mask lhs, Mask rhs)       { return { static_cast<__mmask16>(lhs.m | rhs.m) }; }
+inline Float select(Mask mask, Float ifSet, Float ifClear) { return { _mm512_mask_blend_ps(mask.m, ifClear.v, ifSet.v) }; }
+
+// Split a positive normal value into a mantissa in [1, 2) and its exponent
+inline Float mantissa(Float value, Float& exponent) {
+    exponent = { _mm512_getexp_ps(value.v) };
+    return { _mm512_getmant_ps(value.v, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero) };
+}
+
+// 2^n for integral n in [-126, 127]
+inline Float pow2(Float n) { return { _mm512_scalef_ps(_mm512_set1_ps(1.0f), n.v) }; }
+
+#elif defined(SIMD_AVX2)
+constexpr size_t LANES = 8ULL;
+
+struct Float { __m256 v; };
+struct Mask { __m256 m; };
+
+inline Float broadcast(float value)             { return { _mm256_set1_ps(value) }; }
+inline Float load(const float* values)          { return { _mm256_loadu_ps(values) }; }
+inline void store(float* values, Float value)   { _mm256_storeu_ps(values, value.v); }
+
+inline Float operator+(Float lhs, Float rhs)    { return { _mm256_add_ps(lhs.v, rhs.v) }; }
+inline Float operator-(Float lhs, Float rhs)    { return { _mm256_sub_ps(lhs.v, rhs.v) }; }
+inline Float operator*(Float lhs, Float rhs)    { return { _mm256_mul_ps(lhs.v, rhs.v) }; }
+inline Float operator/(Float lhs, Float rhs)    { return { _mm256_div_ps(lhs.v, rhs.v) }; }
+inline Float fmadd(Float a, Float b, Float c)   { return { _mm256_fmadd_ps(a.v, b.v, c.v) }; }
+inline Float sqrt(Float value)                  { return { _mm256_sqrt_ps(value.v) }; }
+inline Float abs(Float value)                   { return { _mm256_and_ps(value.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF))) }; }
+inline Float min(Float lhs, Float rhs)          { return { _mm256_min_ps(lhs.v, rhs.v) }; }
+inline Float max(Float lhs, Float rhs)          { return { _mm256_max_ps(lhs.v, rhs.v) }; }
+inline Float round(Float value)                 { return { _mm256_round_ps(value.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) }; }
+
+inline Mask operator<(Float lhs, Float rhs)     { return { _mm256_cmp_ps(lhs.v, rhs.v, _CMP_LT_OQ) }; }
+inline Mask operator>(Float lhs, Float rhs)     { return { _mm256_cmp_ps(lhs.v, rhs.v, _CMP_GT_OQ) }; }
+inline Mask operator==(Float lhs, Float rhs)    { return { _mm256_cmp_ps(lhs.v, rhs.v, _CMP_EQ_OQ) }; }
+inline Mask isNaN(Float value)                  { return { _mm256_cmp_ps(value.v, value.v, _CMP_UNORD_Q) }; }
+inline Mask operator|(Mask lhs, Mask rhs)       { return { _mm256_or_ps(lhs.m, rhs.m) }; }
+inline Float select(Mask mask, Float ifSet, Float ifClear) { return { _mm256_blendv_ps(ifClear.v, ifSet.v, mask.m) }; }
+
+// Split a positive normal value into a mantissa in [1, 2) and its exponent
+inline Float mantissa(Float value, Float& exponent) {
+    const __m256i bits  = _mm256_castps_si256(value.v);
+    exponent            = { _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))) };
+    return { _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000))) };
+}
+
+// 2^n for integral n in [-126, 127]
+inline Float pow2(Float n) { return { _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127)), 23)) }; }
+
+#else
+constexpr size_t LANES = 1ULL;
+
+struct Float { float v; };
+struct Mask { bool m; };
+
+inline Float broadcast(float value)             { return { value }; }
+inline Float load(const float* values)          { return { *values }; }
+inline void store(float* values, Float value)   { *values = value.v; }
+
+inline Float operator+(Float lhs, Float rhs)    { return { lhs.v + rhs.v }; }
+inline Float operator-(Float lhs, Float rhs)    { return { lhs.v - rhs.v }; }
+inline Float operator*(Float lhs, Float rhs)    { return { lhs.v * rhs.v }; }
+inline Float operator/(Float lhs, Float rhs)    { return { lhs.v / rhs.v }; }
+inline Float fmadd(Float a, Float b, Float c)   { return { (a.v * b.v) + c.v }; }
+inline Float sqrt(Float value)                  { return { std::sqrt(value.v) }; }
+inline Float abs(Float value)                   { return { std::abs(value.v) }; }
+inline Float min(Float lhs, Float rhs)          { return { std::min(lhs.v, rhs.v) }; }
+inline Float max(Float lhs, Float rhs)          { return { std::max(lhs.v, rhs.v) }; }
+
+inline Mask operator<(Float lhs, Float rhs)     { return { lhs.v < rhs.v }; }
+inline Mask operator>(Float lhs, Float rhs)     { return { lhs.v > rhs.v }; }
+inline Mask operator==(Float lhs, Float rhs)    { return { lhs.v == rhs.v }; }
+inline Mask isNaN(Float value)                  { return { std::isnan(value.v) }; }
+inline Mask operator|(Mask lhs, Mask rhs)       { return { lhs.m || rhs.m }; }
+inline Float select(Mask mask, Float ifSet, Float ifClear) { return mask.m ? ifSet : ifClear; }
+
+inline Float pow(Float base, float exponent)    { return { std::pow(base.v, exponent) }; }
+#endif
+
+#if defined(SIMD_AVX512) || defined(SIMD_AVX2)
+// Base 2 logarithm of a positive normal value, accurate to a few ulp
+inline Float log2(Float value) {
+    // Center the mantissa around one, then log(m) = 2 atanh((m - 1) / (m + 1)) converges quickly
+    Float exponent;
+    Float mant              = mantissa(value, exponent);
+    const Mask aboveSqrt2   = mant > broadcast(1.41421356f);
+    mant                    = select(aboveSqrt2, mant * broadcast(0.5f), mant);
+    exponent                = select(aboveSqrt2, exponent + broadcast(1.0f), exponent);
+
+    const Float t           = (mant - broadcast(1.0f)) / (mant + broadcast(1.0f));
+    const Float tSq         = t * t;
+    Float series            = fmadd(tSq, broadcast(1.0f / 9.0f), broadcast(1.0f / 7.0f));
+    series                  = fmadd(series, tSq, broadcast(1.0f / 5.0f));
+    series                  = fmadd(series, tSq, broadcast(1.0f / 3.0f));
+    series                  = fmadd(series, tSq, broadcast(1.0f));
+    return fmadd(series * t, broadcast(2.0f / 0.69314718f), exponent);
+}
+
+// 2^value, flushing results below the normal range to zero and clamping those above it
+inline Float exp2(Float value) {
+    const Mask underflow    = value < broadcast(-126.0f);
+    const Float clamped     = min(max(value, broadcast(-126.0f)), broadcast(127.0f));
+    const Float integral    = round(clamped);
+    const Float fraction    = (clamped - integral) * broadcast(0.69314718f);    // In [-ln(2) / 2, ln(2) / 2]
+
+    Float series = fmadd(fraction, broadcast(1.0f / 5040.0f), broadcast(1.0f / 720.0f));
+    series = fmadd(series, fraction, broadcast(1.0f / 120.0f));
+    series = fmadd(series, fraction, broadcast(1.0f / 24.0f));
+    series = fmadd(series, fraction, broadcast(1.0f / 6.0f));
+    series = fmadd(series, fraction, broadcast(0.5f));
+    series = fmadd(series, fraction, broadcast(1.0f));
+    series = fmadd(series, fraction, broadcast(1.0f));
+    return select(underflow, broadcast(0.0f), series * pow2(integral));
+}
+
+// base^exponent with the semantics of std::pow for finite values: negative bases give +-|base|^exponent for integral exponents and NaN otherwise
+inline Float pow(Float base, float exponent) {
+    const bool integral         = std::floor(exponent) == exponent;
+    const float negativeSign    = !integral                             ? std::numeric_limits<float>::quiet_NaN()   :
+                                  std::fmod(exponent, 2.0f) != 0.0f     ? -1.0f                                     :
+                                                                          1.0f;
+    const float powerOfZero     = exponent == 0.0f ? 1.0f : (exponent > 0.0f ? 0.0f : std::numeric_limits<float>::infinity());
+
+    const Float magnitude   = abs(base);
+    Float power             = exp2(log2(magnitude) * broadcast(exponent));
+    power                   = select(magnitude == broadcast(0.0f), broadcast(powerOfZero), power);
+    power                   = select(base < broadcast(0.0f), power * broadcast(negativeSign), power);
+    return select(isNaN(base), base, power);
+}
+#endif
+
+} // namespace simd
+
+#endif // _SIMD_H_
@@ -30,30 +30,36 @@ float linearMap(float val, float domainMin, float domainMax, float rangeMin, flo
     return mappedValue;
 }
 
-glm::vec3 diffuseAlbedo(const HitInfo& hitInfo, const Features& features) {
-    return features.enableTextureMapping && hitInfo.material.kdTexture                   ?
-           acquireTexel(*hitInfo.material.kdTexture.get(), hitInfo.texCoord, features)   :
-           hitInfo.material.kd;
+glm::vec3 diffuseAlbedo(const HitInfo& hitInfo, const Material& material, const Features& features) {
+    return features.enableTextureMapping && material.kdTexture                   ?
+           acquireTexel(*material.kdTexture.get(), hitInfo.texCoord, features)   :
+           material.kd;
+}
+
+Ray constructShadowRay(const glm::vec3& samplePos, const Ray& ray) {
+    return constructShadowRay(samplePos, ray.origin + (ray.t * ray.direction));
+}
+
+Ray constructShadowRay(const glm::vec3& samplePos, glm::vec3 shadingPoint) {
+    glm::vec3 pointToSample = glm::normalize(samplePos - shadingPoint); 
+    shadingPoint            += pointToSample * SHADOW_RAY_EPSILON; // Small epsilon in shadow ray direction to avoid self-shadowing
+    return { shadingPoint, pointToSample, glm::distance(shadingPoint, samplePos) };
 }
 
 // test the visibility at a given light sample
 // returns true if sample is visible, false otherwise
+template <typename DebugDraw>
 bool testVisibilityLightSample(const glm::vec3& samplePos, const EmbreeInterface& embreeInterface, const Features& features, Ray ray, HitInfo hitInfo) {
     // Construct shadow ray
-    glm::vec3 shadingPoint  = ray.origin + (ray.t * ray.direction);
-    glm::vec3 pointToSample = glm::normalize(samplePos - shadingPoint); 
-    shadingPoint            += pointToSample * SHADOW_RAY_EPSILON; // Small epsilon in shadow ray direction to avoid self-shadowing
-    Ray shadowRay { shadingPoint, pointToSample, glm::distance(shadingPoint, samplePos) };
+    Ray shadowRay = constructShadowRay(samplePos, ray);
 
     // Visibility test and debug rays
     bool visible = !embreeInterface.anyHit(shadowRay);
-    if (visible) {
-        drawRay(shadowRay, SHADOW_RAY_NO_HIT_COLOR);
-        return true;
-    }
-    drawRay(shadowRay, SHADOW_RAY_INTERSECT_COLOR);
-    return false;
+    if constexpr (DebugDraw::enabled) { drawRay(shadowRay, visible ? SHADOW_RAY_NO_HIT_COLOR : SHADOW_RAY_INTERSECT_COLOR); }
+    return visible;
 }
+template bool testVisibilityLightSample<DebugDrawOff>(const glm::vec3& samplePos, const EmbreeInterface& embreeInterface, const Features& features, Ray ray, HitInfo hitInfo);
+template bool testVisibilityLightSample<DebugDrawOn>(const glm::vec3& samplePos, const EmbreeInterface& embreeInterface, const Features& features, Ray ray, HitInfo hitInfo);
 
 void errorFunction(void* userPtr, enum RTCError error, const char* str) {
     std::cout << std::format("[EMBREE] {}: {}", magic_enum::enum_name(error), str) << std::endl;
@@ -26,7 +26,10 @@ template<typename T>
 inline bool inRangeInclusive(T val, T low, T high) { return low <= val && val <= high; }
 
 // Convenience or base project
-glm::vec3 diffuseAlbedo(const HitInfo& hitInfo, const Features& features);
+glm::vec3 diffuseAlbedo(const HitInfo& hitInfo, const Material& material, const Features& features);
+Ray constructShadowRay(const glm::vec3& samplePos, const Ray& ray);
+Ray constructShadowRay(const glm::vec3& samplePos, glm::vec3 shadingPoint);
+template <typename DebugDraw = DebugDrawOff>
 bool testVisibilityLightSample(const glm::vec3& samplePos, const EmbreeInterface& embreeInterface, const Features& features, Ray ray, HitInfo hitInfo);
 
 // Embree
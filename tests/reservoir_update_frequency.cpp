@@ -0,0 +1,98 @@
+// Statistical check that batched reservoir updates select samples with the same probabilities as sequential ones.
+// Both are run over many independent trials, after which the selection frequency of every candidate in every sub-reservoir
+// is compared to its expected probability: its weight over the total weight assigned to that sub-reservoir
+#include <rendering/reservoir.h>
+#include <utils/sampler.h>
+
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+constexpr size_t CAPACITY       = 4ULL;
+constexpr uint32_t NUM_TRIALS   = 200000U;
+constexpr double MAX_DEVIATIONS = 5.0; // Allowed distance from the expected frequency, in standard deviations
+
+// Selection counts indexed [sub-reservoir][candidate + 1], where index 0 counts the sub-reservoir keeping its initial sample
+using SelectionCounts = std::vector<std::vector<uint32_t>>;
+
+static bool checkFrequencies(const char* name, const SelectionCounts& counts, const std::vector<std::vector<double>>& expected) {
+    bool passed = true;
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < counts.size(); reservoirIdx++) {
+        for (size_t candidateIdx = 0ULL; candidateIdx < counts[reservoirIdx].size(); candidateIdx++) {
+            const double probability    = expected[reservoirIdx][candidateIdx];
+            const double frequency      = static_cast<double>(counts[reservoirIdx][candidateIdx]) / NUM_TRIALS;
+            const double tolerance      = (MAX_DEVIATIONS * std::sqrt(probability * (1.0 - probability) / NUM_TRIALS)) + 1e-6;
+            if (std::abs(frequency - probability) > tolerance) {
+                std::cerr << std::format("{}: sub-reservoir {} selected candidate {} with frequency {:.5f}, expected {:.5f}",
+                                         name, reservoirIdx, static_cast<int>(candidateIdx) - 1, frequency, probability) << std::endl;
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
+
+static bool testWeights(const std::vector<float>& weights, size_t numSamples) {
+    // Candidates are told apart by their light index, offset by one so the initial sample keeps index 0
+    std::vector<LightSample> candidates(weights.size());
+    for (size_t candidateIdx = 0ULL; candidateIdx < candidates.size(); candidateIdx++) { candidates[candidateIdx].lightIdx = static_cast<uint32_t>(candidateIdx) + 1U; }
+    const std::vector<float> targetPdfs(weights.size(), 1.0f);
+
+    SelectionCounts sequentialCounts(numSamples, std::vector<uint32_t>(weights.size() + 1ULL, 0U));
+    SelectionCounts batchedCounts = sequentialCounts;
+    std::vector<size_t> assignments(weights.size());
+    std::vector<float> prefixSums(weights.size());
+    std::vector<uint32_t> groupedIdxs(weights.size());
+    for (uint32_t trial = 0U; trial < NUM_TRIALS; trial++) {
+        Reservoir<CAPACITY> sequential(numSamples);
+        Sampler sequentialSampler(glm::ivec2(static_cast<int>(trial), 0), 0U, SampleStream::InitialSamples);
+        for (size_t candidateIdx = 0ULL; candidateIdx < candidates.size(); candidateIdx++) {
+            sequential.update(candidates[candidateIdx], weights[candidateIdx], targetPdfs[candidateIdx], sequentialSampler);
+        }
+
+        Reservoir<CAPACITY> batched(numSamples);
+        Sampler batchedSampler(glm::ivec2(static_cast<int>(trial), 1), 0U, SampleStream::InitialSamples);
+        batched.updateBatch(candidates, weights, targetPdfs, batchedSampler, assignments, prefixSums, groupedIdxs);
+
+        for (size_t reservoirIdx = 0ULL; reservoirIdx < numSamples; reservoirIdx++) {
+            sequentialCounts[reservoirIdx][sequential.outputSamples[reservoirIdx].lightSample.lightIdx]++;
+            batchedCounts[reservoirIdx][batched.outputSamples[reservoirIdx].lightSample.lightIdx]++;
+        }
+    }
+
+    // Assignment to sub-reservoirs only depends on the weights, so the expected probabilities follow from the last one
+    std::vector<double> assignedWeights(numSamples, static_cast<double>(std::numeric_limits<float>::min()));
+    for (size_t candidateIdx = 0ULL; candidateIdx < weights.size(); candidateIdx++) { assignedWeights[assignments[candidateIdx]] += static_cast<double>(weights[candidateIdx]); }
+    std::vector<std::vector<double>> expected(numSamples, std::vector<double>(weights.size() + 1ULL, 0.0));
+    for (size_t reservoirIdx = 0ULL; reservoirIdx < numSamples; reservoirIdx++) {
+        expected[reservoirIdx][0ULL] = static_cast<double>(std::numeric_limits<float>::min()) / assignedWeights[reservoirIdx];
+    }
+    for (size_t candidateIdx = 0ULL; candidateIdx < weights.size(); candidateIdx++) {
+        const size_t reservoirIdx                       = assignments[candidateIdx];
+        expected[reservoirIdx][candidateIdx + 1ULL]     = static_cast<double>(weights[candidateIdx]) / assignedWeights[reservoirIdx];
+    }
+
+    const bool sequentialPassed = checkFrequencies("Sequential", sequentialCounts, expected);
+    const bool batchedPassed    = checkFrequencies("Batched", batchedCounts, expected);
+    return sequentialPassed && batchedPassed;
+}
+
+int main() {
+    const std::vector<float> weights = { 1.0f, 4.0f, 0.5f, 2.0f, 0.0f, 3.0f, 0.25f, 1.5f, 6.0f, 0.75f };
+    bool passed = true;
+    for (size_t numSamples : std::array<size_t, 3ULL> { 1ULL, 2ULL, CAPACITY }) {
+        const bool weightsPassed = testWeights(weights, numSamples);
+        std::cout << std::format("{} sub-reservoir(s): {}", numSamples, weightsPassed ? "passed" : "FAILED") << std::endl;
+        passed &= weightsPassed;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}